@@ -0,0 +1,60 @@
+#pragma once
+
+#include <gstreamermm.h>
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+   Output through libao instead of a gstreamer sink, PLAYER_AUDIO_SINK=ao.
+
+   The output pipeline ends in an appsink that takes 16 bit stereo
+   at 44.1 kHz. Its streaming thread copies every buffer into an SpscRing
+   and waits while the ring is full, a thread of our own takes fixed
+   periods out of the ring and hands them to ao_play(), which blocks
+   at the pace of the device. The appsink does not sync to the clock:
+   the device sets the pace, and positions run ahead of what is audible
+   by at most the ring's length.
+
+   Set through the environment:
+   PLAYER_AO_DRIVER - libao driver name, the default driver otherwise.
+                      "null" plays nothing, at the pace of a device
+   PLAYER_AO_FILE   - write to this file with a file driver (wav, raw, au),
+                      as fast as it can
+   PLAYER_AO_BUFFER - ring length in milliseconds, what the latency profile
+                      gives the sink otherwise (see output.hpp)
+
+   If the ring runs dry while playing the device gets nothing until there
+   is a full period again, and that is counted as an underrun (except
+   for a file, where nothing is heard). At EOS the rest of the ring is
+   played, the last period can be short, and only then the sink posts EOS
+   */
+namespace aooutput
+{
+    struct Stats
+    {
+        size_t   fill = 0;
+        size_t   capacity = 0;
+        // how long what is in the ring plays for, in nanoseconds
+        gint64   fillTime = 0;
+        uint64_t underruns = 0;
+    };
+
+    // opens the device and starts the output thread with a ring of bufferMs,
+    // returns the appsink or an empty pointer if the device could not be opened
+    Glib::RefPtr<Gst::Element> createSink(size_t bufferMs);
+    void end();
+
+    // the output thread only drains the ring while playing,
+    // so what is in it is kept over a pause
+    void setPlaying(bool playing);
+    // a streaming thread that waits for room in the ring would keep
+    // the pipeline from changing state, so before a reset (or anything
+    // else that stops streaming) it is told to give up with beginFlush().
+    // endFlush() drops what is left in the ring once streaming has stopped
+    void beginFlush();
+    void endFlush();
+
+    // can be called from any thread until end()
+    Stats stats();
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+
+/*
+   Headless front end: player --daemon [--socket PATH] FILES...
+
+   Clients connect to a unix socket and send one command per line,
+   every command gets exactly one line back, in the same order,
+   so a client can send many commands without waiting for the replies.
+   Replies are "ok", "error <reason>" or the requested data.
+
+       status                       state, position and duration in seconds,
+                                    tracks left, track id and path
+       cache                        decoded audio cache hits, misses,
+                                    tracks and bytes kept
+       output                       libao ring fill and capacity in bytes
+                                    and underruns, all 0 with other sinks
+       latency                      latency profile, milliseconds of audio
+                                    in front of the device, underruns and
+                                    underruns per hour of playback
+       stats                        numbers on the current track:
+                                    milliseconds from attaching it until
+                                    PAUSED, PLAYING and the first buffer
+                                    (-1 if not yet), underruns, QoS messages,
+                                    errors, warnings, ms of decoder CPU;
+                                    "stats none" if nothing is playing
+       pause | resume | toggle
+       next [N] | previous [N]
+       stop | stopall
+       seek [+|-]SECONDS [accurate] with a sign it is relative
+       jump INDEX                   position in the queue
+       play KIND ARG                same as enqueue now KIND ARG
+       enqueue MODE[,shuffle][,spread] KIND ARG
+                                    MODE is now, next (after the current track),
+                                    afterlist, end or suspend.
+                                    KIND is track (ARG is a path), artist,
+                                    album or playlist (ARG is a playlist file)
+       quit
+
+   All clients are served by one thread with poll(2). The socket is only
+   accessible to its owner. A socket left at the path by a player that is
+   gone is replaced, anything else there (a file, a player that still
+   answers) is left alone and run() fails
+   */
+namespace control
+{
+    // $XDG_RUNTIME_DIR/player.sock, or a per-user file in /tmp
+    std::string defaultSocketPath();
+
+    // serves clients until quit is received or the process gets SIGINT or SIGTERM.
+    // returns false if the socket could not be set up
+    bool run(const std::string& socketPath);
+}
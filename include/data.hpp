@@ -5,10 +5,13 @@
 #include <ao/ao.h>
 #include <string>
 #include <map>
+#include <unordered_map>
 #include <list>
 #include <thread>
 #include <memory>
+#include <atomic>
 #include <chrono>
+#include <cstdint>
 
 
 namespace data
@@ -24,54 +27,108 @@ namespace data
     extern std::shared_ptr<Artist> allArtists;
     extern std::shared_ptr<Artist> unknownArtist;
 
+    // keyed by normalizePath(track->filepath)
+    extern std::unordered_map<std::string, std::shared_ptr<Track>> tracksByPath;
+
     void init();
     void end();
 
     void addTrack(std::shared_ptr<Track> track);
     std::list<std::shared_ptr<Artist>> getArtists();
 
+    // returns nullptr if there is no track with this path in the library
+    std::shared_ptr<Track> findTrack(const std::string& path);
+
+    // makes path absolute and removes "." and ".." components
+    // without touching the filesystem
+    std::string normalizePath(const std::string& path);
+
+    /*
+       Source section of one track: filesrc ! decodebin,
+       decoded audio comes out of the "src" ghost pad of bin.
+       Files on local filesystems are read through a memory mapping
+       instead of filesrc (see mapped_source.hpp), and tracks that were
+       decoded lately are played from memory (see pcm_cache.hpp).
+
+       If only the beginning of the track is in memory, it is played
+       by its own source into a concat, and decodebin's audio is the
+       second input of it: the file is decoded from the start, what
+       is cached is dropped and the rest is shifted to follow the cache.
+
+       For playback it is attached to the output (see output.hpp),
+       Track::Track puts it into a pipeline of its own to read tags
+       */
     struct OpenedTrack
     {
         const Track* parent;
         std::string filepath;
 
-        Glib::RefPtr<Gst::Pipeline> pipeline;
-
-        Glib::RefPtr<Gst::FileSrc> src;
+        Glib::RefPtr<Gst::Bin> bin;
 
+        Glib::RefPtr<Gst::Element> src;
         Glib::RefPtr<Gst::Element> decode;
-        Glib::RefPtr<Gst::Element> conv;
-        Glib::RefPtr<Gst::Element> resample;
-        Glib::RefPtr<Gst::Element> sink;
+        Glib::RefPtr<Gst::GhostPad> pad;
+
+        // applies the loudness gain (see loudness.hpp), empty if that is off
+        Glib::RefPtr<Gst::Element> volume;
+
+        // pad of the output this track is linked to, empty if not attached
+        Glib::RefPtr<Gst::Pad> outputPad;
+
+        // src plays decoded audio from pcmcache instead of the file
+        bool cached = false;
+        // where the cached beginning ends if the rest comes from the file,
+        // Gst::CLOCK_TIME_NONE if none of it or all of it is cached
+        guint64 cachedUntil = Gst::CLOCK_TIME_NONE;
+
+        enum class Source
+        {
+            // from memory if the track is in pcmcache
+            any,
+            // the file, mapped if it can be
+            file,
+            // filesrc, reading tags only touches the header
+            tags
+        };
 
         OpenedTrack();
-        OpenedTrack(const Track* parent);
+        OpenedTrack(const Track* parent, Source source = Source::any);
         OpenedTrack(OpenedTrack&& other);
 
         OpenedTrack& operator= (const OpenedTrack&) = delete;
         void operator= (OpenedTrack&& other);
 
+        // also detaches it from the output
         void markAsInvalid();
 
         bool isValid() const;
 
+        // true once all of the track's audio has left the bin
+        bool finished() const;
+
         ~OpenedTrack();
 
         private:
         bool valid = false;
+        // set from a streaming thread, shared so that it survives moves
+        std::shared_ptr<std::atomic<bool>> eos;
     };
 
     struct Track
     {
         std::string filepath;
+        // hash of the normalized path, stays the same between runs
+        uint64_t id;
 
         std::string name;
         std::string artistName;
         std::string albumName;
 
         Track(const std::string& file);
+        // tags that are already known, the file is not read
+        Track(const std::string& file, const std::string& name, const std::string& artistName, const std::string& albumName);
 
-        OpenedTrack open() const;
+        OpenedTrack open(OpenedTrack::Source source = OpenedTrack::Source::any) const;
         void testPrint() const;
     };
 
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "data.hpp"
+#include "playlist.hpp"
+
+#include <list>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+/*
+   Finds copies of the same recording under different paths.
+
+   Files are hashed in the background by a small worker pool,
+   the hash only covers the audio payload, so the same file
+   with different tags is still a duplicate.
+   Hashes are cached in the library index.
+   */
+namespace duplicates
+{
+    // bytes per second all hashing workers together may read
+    extern size_t ioBudget;
+    extern size_t workerCount;
+
+    // does not block, hashing happens in the background
+    void start();
+    void end();
+
+    // returns false if the track has not been hashed yet
+    bool contentHash(const std::shared_ptr<data::Track>& track, uint64_t& hash);
+
+    // true if the track has a copy that is shown instead of it.
+    // of all copies the one with the smallest path is shown
+    bool isDuplicate(const std::shared_ptr<data::Track>& track);
+
+    // number of known copies including the track itself, 0 if it has not been hashed yet
+    size_t copyCount(const std::shared_ptr<data::Track>& track);
+
+    std::list<std::shared_ptr<data::Track>> collapse(const std::list<std::shared_ptr<data::Track>>& tracks);
+
+    size_t hashedCount();
+}
+
+// All tracks that have at least one copy, in library order
+class DuplicatesPlaylist : public Playlist
+{
+    public:
+    DuplicatesPlaylist(const std::string& name = "duplicates");
+
+    virtual std::list<std::shared_ptr<data::Track>> getTracks() const override;
+    virtual void testPrint() const override;
+};
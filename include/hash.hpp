@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+// 64-bit FNV-1a, can be fed in pieces
+class Fnv1a
+{
+    uint64_t state = 14695981039346656037ull;
+
+    public:
+    void update(const void* data, size_t size)
+    {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++)
+        {
+            state ^= bytes[i];
+            state *= 1099511628211ull;
+        }
+    }
+
+    void update(const std::string& str)
+    {
+        update(str.data(), str.size());
+    }
+
+    uint64_t digest() const
+    {
+        return state;
+    }
+
+    static uint64_t hash(const std::string& str)
+    {
+        Fnv1a h;
+        h.update(str);
+        return h.digest();
+    }
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "data.hpp"
+
+#include <memory>
+#include <cstdint>
+#include <ctime>
+
+/*
+   Persistent listening history.
+
+   Every finished or interrupted track is appended to player.history,
+   which is memory-mapped and never rewritten. On top of it there is an index
+   of play counts and last play times per track, rebuilt from the log on init.
+
+   record() only queues the entry, the file is written by a separate thread,
+   so it is safe to call from the playback thread
+   */
+namespace history
+{
+    struct Stats
+    {
+        // only plays of at least playedThreshold count for both
+        uint32_t    playCount  = 0;
+        std::time_t lastPlayed = 0; // 0 means never
+    };
+
+    // a track counts as played if at least this fraction of it was played
+    extern float playedThreshold;
+
+    // where the log is kept, player.history in the working directory by default.
+    // read by init()
+    extern const char* historyPath;
+
+    void init();
+    void end();
+
+    void record(const std::shared_ptr<data::Track>& track, float fractionPlayed);
+
+    // O(1), returns empty stats for tracks that have never been played
+    Stats stats(uint64_t trackId);
+}
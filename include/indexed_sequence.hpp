@@ -0,0 +1,395 @@
+#pragma once
+
+#include <iterator>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+#include <cassert>
+
+/*
+   Sequence with O(log n) insert, erase and move at any position.
+
+   It is an implicit treap: nodes are ordered by position instead of a key,
+   every node knows the size of its subtree and its parent, so both
+   "element at position" and "position of element" are O(log n).
+
+   insert() returns a Handle that stays valid until that element is erased,
+   even if it is moved around or other elements are inserted before it.
+   That is what makes it possible to index elements from outside
+   (see SimplePlaylist).
+
+   Nothing const writes to the sequence, so it can be read
+   from several threads at once as long as nobody modifies it.
+   */
+template< typename T >
+class IndexedSequence
+{
+    struct Node
+    {
+        T value;
+        uint32_t priority;
+        size_t size = 1;
+        Node* left   = nullptr;
+        Node* right  = nullptr;
+        Node* parent = nullptr;
+
+        Node(T value, uint32_t priority) :
+            value(std::move(value)),
+            priority(priority) {}
+    };
+
+    public:
+    using Handle = const Node*;
+
+    class const_iterator
+    {
+        friend class IndexedSequence;
+        const Node* node;
+
+        const_iterator(const Node* node) : node(node) {}
+
+        public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type        = T;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = const T*;
+        using reference         = const T&;
+
+        reference operator* () const { return node->value; }
+        pointer operator-> () const { return &node->value; }
+        Handle handle() const { return node; }
+
+        const_iterator& operator++ ()
+        {
+            node = IndexedSequence::successor(node);
+            return *this;
+        }
+
+        const_iterator operator++ (int)
+        {
+            auto ret = *this;
+            ++*this;
+            return ret;
+        }
+
+        bool operator== (const const_iterator& other) const { return node == other.node; }
+        bool operator!= (const const_iterator& other) const { return node != other.node; }
+    };
+
+    IndexedSequence() {}
+
+    IndexedSequence(const IndexedSequence&) = delete;
+    IndexedSequence& operator= (const IndexedSequence&) = delete;
+
+    IndexedSequence(IndexedSequence&& other) :
+        root(other.root),
+        seed(other.seed)
+    {
+        other.root = nullptr;
+    }
+
+    IndexedSequence& operator= (IndexedSequence&& other)
+    {
+        if (this != &other)
+        {
+            clear();
+            root = other.root;
+            seed = other.seed;
+            other.root = nullptr;
+        }
+        return *this;
+    }
+
+    ~IndexedSequence()
+    {
+        clear();
+    }
+
+    size_t size() const { return sizeOf(root); }
+    bool empty() const { return root == nullptr; }
+
+    const_iterator begin() const { return const_iterator(leftmost(root)); }
+    const_iterator end() const { return const_iterator(nullptr); }
+
+    Handle insert(size_t pos, T value)
+    {
+        assert(pos <= size());
+
+        Node* node = new Node(std::move(value), nextPriority());
+        insertNode(pos, node);
+        return node;
+    }
+
+    Handle pushBack(T value)
+    {
+        return insert(size(), std::move(value));
+    }
+
+    Handle pushFront(T value)
+    {
+        return insert(0, std::move(value));
+    }
+
+    void erase(Handle handle)
+    {
+        delete detach(position(handle));
+    }
+
+    void eraseAt(size_t pos)
+    {
+        assert(pos < size());
+        delete detach(pos);
+    }
+
+    // element keeps its handle
+    void move(size_t from, size_t to)
+    {
+        assert(from < size() && to < size());
+        if (from == to)
+        {
+            return;
+        }
+
+        insertNode(to, detach(from));
+    }
+
+    // removes everything before pos and returns it as a separate sequence,
+    // handles stay valid and now belong to the returned sequence
+    IndexedSequence splitFront(size_t pos)
+    {
+        assert(pos <= size());
+
+        Node* front;
+        Node* back;
+        split(root, pos, front, back);
+        setRoot(back);
+
+        IndexedSequence ret;
+        ret.setRoot(front);
+        return ret;
+    }
+
+    // moves all elements of other to pos, handles of other stay valid
+    void splice(size_t pos, IndexedSequence&& other)
+    {
+        assert(pos <= size());
+
+        Node* front;
+        Node* back;
+        split(root, pos, front, back);
+        setRoot(merge(merge(front, other.root), back));
+
+        other.root = nullptr;
+    }
+
+    Handle handleAt(size_t pos) const
+    {
+        assert(pos < size());
+
+        const Node* node = root;
+        while (true)
+        {
+            size_t leftSize = sizeOf(node->left);
+            if (pos < leftSize)
+            {
+                node = node->left;
+            }
+            else if (pos == leftSize)
+            {
+                return node;
+            }
+            else
+            {
+                pos -= leftSize + 1;
+                node = node->right;
+            }
+        }
+    }
+
+    size_t position(Handle handle) const
+    {
+        const Node* node = handle;
+        size_t pos = sizeOf(node->left);
+        while (node->parent)
+        {
+            if (node == node->parent->right)
+            {
+                pos += sizeOf(node->parent->left) + 1;
+            }
+            node = node->parent;
+        }
+        return pos;
+    }
+
+    static const T& value(Handle handle)
+    {
+        return handle->value;
+    }
+
+    // O(log n), a walk down from the root by subtree sizes
+    const T& at(size_t pos) const
+    {
+        return handleAt(pos)->value;
+    }
+
+    const T& front() const { return leftmost(root)->value; }
+    const T& back() const { return at(size() - 1); }
+
+    void clear()
+    {
+        destroy(root);
+        root = nullptr;
+    }
+
+    private:
+    Node* root = nullptr;
+    uint32_t seed = 2463534242u;
+
+    uint32_t nextPriority()
+    {
+        // xorshift32, priorities only need to look random
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed;
+    }
+
+    void setRoot(Node* node)
+    {
+        root = node;
+        if (root)
+        {
+            root->parent = nullptr;
+        }
+    }
+
+    void insertNode(size_t pos, Node* node)
+    {
+        Node* front;
+        Node* back;
+        split(root, pos, front, back);
+        setRoot(merge(merge(front, node), back));
+    }
+
+    // unlinks the node at pos from the tree without deleting it
+    Node* detach(size_t pos)
+    {
+        Node* front;
+        Node* rest;
+        Node* node;
+        Node* back;
+        split(root, pos, front, rest);
+        split(rest, 1, node, back);
+        setRoot(merge(front, back));
+
+        node->left = node->right = node->parent = nullptr;
+        node->size = 1;
+        return node;
+    }
+
+    static size_t sizeOf(const Node* node)
+    {
+        return node ? node->size : 0;
+    }
+
+    static void update(Node* node)
+    {
+        node->size = 1 + sizeOf(node->left) + sizeOf(node->right);
+        if (node->left)
+        {
+            node->left->parent = node;
+        }
+        if (node->right)
+        {
+            node->right->parent = node;
+        }
+    }
+
+    // first k elements go to left, the rest go to right
+    static void split(Node* node, size_t k, Node*& left, Node*& right)
+    {
+        if (!node)
+        {
+            left = right = nullptr;
+            return;
+        }
+
+        if (sizeOf(node->left) < k)
+        {
+            split(node->right, k - sizeOf(node->left) - 1, node->right, right);
+            left = node;
+        }
+        else
+        {
+            split(node->left, k, left, node->left);
+            right = node;
+        }
+        update(node);
+
+        if (left)
+        {
+            left->parent = nullptr;
+        }
+        if (right)
+        {
+            right->parent = nullptr;
+        }
+    }
+
+    static Node* merge(Node* left, Node* right)
+    {
+        if (!left)
+        {
+            return right;
+        }
+        if (!right)
+        {
+            return left;
+        }
+
+        if (left->priority > right->priority)
+        {
+            left->right = merge(left->right, right);
+            update(left);
+            return left;
+        }
+        else
+        {
+            right->left = merge(left, right->left);
+            update(right);
+            return right;
+        }
+    }
+
+    static const Node* leftmost(const Node* node)
+    {
+        while (node && node->left)
+        {
+            node = node->left;
+        }
+        return node;
+    }
+
+    static const Node* successor(const Node* node)
+    {
+        if (node->right)
+        {
+            return leftmost(node->right);
+        }
+        while (node->parent && node == node->parent->right)
+        {
+            node = node->parent;
+        }
+        return node->parent;
+    }
+
+    static void destroy(Node* node)
+    {
+        if (node)
+        {
+            destroy(node->left);
+            destroy(node->right);
+            delete node;
+        }
+    }
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <cstddef>
+
+/*
+   Token bucket for background reads, so that they leave
+   enough of the disk (or the network share) to playback.
+
+   Can be shared by several threads, each one sleeps
+   until its share of the budget is available
+   */
+class IoThrottle
+{
+    public:
+    // budget is in bytes per second, 0 means unlimited
+    void take(size_t bytes, size_t budget)
+    {
+        using namespace std::chrono;
+
+        if (budget == 0)
+        {
+            return;
+        }
+
+        steady_clock::time_point wakeUp;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto now = steady_clock::now();
+            if (next < now)
+            {
+                next = now;
+            }
+            wakeUp = next;
+            next += duration_cast<steady_clock::duration>(duration<double>(static_cast<double>(bytes) / budget));
+        }
+        std::this_thread::sleep_until(wakeUp);
+    }
+
+    private:
+    std::mutex mutex;
+    std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <functional>
+#include <cstdint>
+#include <ctime>
+
+/*
+   Things we know about files that are expensive to compute,
+   kept on disk between runs in player.index next to player.log.
+
+   An entry is only valid while size and modification time of the file
+   stay the same, lookup() checks that.
+
+   All functions are thread-safe
+   */
+namespace libindex
+{
+    struct Entry
+    {
+        int64_t size  = -1;
+        int64_t mtime = -1;
+
+        bool     hasContentHash = false;
+        uint64_t contentHash    = 0;
+
+        // see loudness.hpp
+        bool     hasLoudness    = false;
+        double   loudness       = 0;
+        double   peak           = 0;
+        uint64_t loudnessBlocks = 0;
+    };
+
+    void load();
+    void save();
+
+    // fills size and mtime from the filesystem,
+    // returns false if the file could not be stat'ed
+    bool stat(const std::string& path, Entry& entry);
+
+    // returns false if there is no up-to-date entry for the file
+    bool lookup(const std::string& path, Entry& entry);
+    void store(const std::string& path, const Entry& entry);
+
+    // changes the entry in place, so that workers filling in different
+    // fields of the same file do not overwrite each other.
+    // an entry that is out of date is started over.
+    // returns false if the file could not be stat'ed
+    bool update(const std::string& path, const std::function<void(Entry&)>& change);
+}
@@ -5,6 +5,7 @@
 #include <string>
 #include <ostream>
 #include <chrono>
+#include <mutex>
 #include <ctime>
 
 enum class LogType
@@ -17,6 +18,9 @@ enum class LogType
 
 using LT = LogType;
 
+// held while a line is written, logging happens from worker and streaming threads too
+std::mutex& logMutex();
+
 class Log
 {
     std::ostream& out;
@@ -38,6 +42,9 @@ class Log
 
     ~Log()
     {
+        std::lock_guard<std::mutex> lock(logMutex());
+
+        // ctime() returns a static buffer, so it is only called under the lock as well
         auto timestamp = std::chrono::system_clock().to_time_t(std::chrono::system_clock().now());
         std::string timestampStr = std::ctime(&timestamp);
         //
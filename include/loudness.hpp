@@ -0,0 +1,64 @@
+#pragma once
+
+#include "data.hpp"
+
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+/*
+   Evens out the volume of tracks and albums.
+
+   Tracks are decoded in the background on a worker pool and measured
+   as in EBU R128 (see r128.hpp). The workers run at idle priority and
+   their pipelines only decode as fast as the workers take the audio,
+   so analysis only gets the cores that playback does not need.
+   Results are cached in the library index.
+
+   A track that has been measured is played with a volume element in its
+   bin set to the gain that brings it to referenceLoudness, or brings its
+   album there once every track of it is measured. The gain is lowered
+   if it would make the peak clip.
+
+   PLAYER_REPLAYGAIN picks the gain: off, track (the default) or album
+   */
+namespace loudness
+{
+    enum class GainMode
+    {
+        off,
+        track,
+        album
+    };
+
+    extern GainMode mode;
+    // LUFS everything is brought to, same as ReplayGain 2.0
+    extern double referenceLoudness;
+    // 0 means one per hardware core
+    extern size_t workerCount;
+
+    struct Measurement
+    {
+        // LUFS
+        double loudness = 0;
+        // largest sample, 1.0 is full scale
+        double peak = 0;
+        // how much of the track was loud enough to count
+        uint64_t blocks = 0;
+    };
+
+    // reads the mode from the environment.
+    // does not block, analysis happens in the background
+    void start();
+    void end();
+
+    bool enabled();
+
+    // returns false if the track has not been measured yet
+    bool measurement(const data::Track& track, Measurement& result);
+
+    // volume for the track in the current mode, 1.0 if it is not known yet
+    double gain(const data::Track& track);
+
+    size_t measuredCount();
+}
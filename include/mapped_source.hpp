@@ -0,0 +1,35 @@
+#pragma once
+
+#include <gstreamermm.h>
+
+#include <string>
+
+/*
+   Source element that serves a file from a memory mapping.
+
+   It is an appsrc in random access mode that pushes buffers wrapping
+   the mapped pages, so nothing is copied and there is no read(2)
+   per buffer like with filesrc. The mapping lives until the last
+   buffer that points into it is freed.
+
+   A file that is truncated while it is mapped would raise SIGBUS on
+   the pages past its new end. A SIGBUS handler puts zeroes there instead
+   (signals in memory that is not a mapping are left to whatever handled
+   them before), and every buffer is checked against the size of the file,
+   so the stream ends where the file does now.
+
+   Only used for local filesystems: on network filesystems page faults
+   can stall for a long time and files change under the mapping far more
+   often, so filesrc is used there
+   */
+namespace mappedsource
+{
+    // PLAYER_MMAP=0 turns it off
+    bool enabled();
+
+    // false for network and FUSE filesystems or if the filesystem can not be checked
+    bool suitable(const std::string& path);
+
+    // empty if the file can not be mapped, or too many are at once
+    Glib::RefPtr<Gst::Element> create(const std::string& path);
+}
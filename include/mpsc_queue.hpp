@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+/*
+   Bounded lock-free queue for many producers and a single consumer.
+
+   Every cell has a sequence number that tells whose turn it is:
+   producers claim a cell by bumping the enqueue position with a CAS
+   and publish it by advancing its sequence, the consumer frees it
+   by advancing the sequence by one more lap. Neither side takes a lock
+   or waits for the other: a push into a full queue fails and it is up
+   to the caller what to do then.
+   (D. Vyukov's bounded queue with the consumer side simplified)
+
+   push() may be called from any thread, pop() only from one thread at a time
+   */
+template< typename T >
+class MpscQueue
+{
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    public:
+    // capacity is rounded up to a power of two
+    explicit MpscQueue(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity)
+        {
+            size *= 2;
+        }
+
+        mask = size - 1;
+        cells.reset(new Cell[size]);
+        for (size_t i = 0; i < size; i++)
+        {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator= (const MpscQueue&) = delete;
+
+    // returns false if the queue is full, value is left untouched then
+    bool push(T&& value)
+    {
+        Cell* cell;
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        while (true)
+        {
+            cell = &cells[pos & mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+
+            if (diff == 0)
+            {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->value = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // returns false if the queue is empty
+    bool pop(T& value)
+    {
+        Cell* cell = &cells[dequeuePos & mask];
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        if (static_cast<intptr_t>(sequence) - static_cast<intptr_t>(dequeuePos + 1) < 0)
+        {
+            return false;
+        }
+
+        value = std::move(cell->value);
+        cell->value = T();
+        cell->sequence.store(dequeuePos + mask + 1, std::memory_order_release);
+        dequeuePos++;
+        return true;
+    }
+
+    size_t capacity() const
+    {
+        return mask + 1;
+    }
+
+    private:
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+
+    // on separate cache lines, producers hammer the first one
+    alignas(64) std::atomic<size_t> enqueuePos{ 0 };
+    alignas(64) size_t dequeuePos = 0;
+};
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "data.hpp"
+
+#include <gstreamermm.h>
+
+#include <string>
+#include <functional>
+
+/*
+   The long-lived part of playback:
+
+       concat ! audioconvert ! audioresample ! queue ! sink
+
+   It is built once and stays up for the whole run, so the audio device
+   is opened once. Tracks only bring their source section
+   (see data::OpenedTrack) and are attached to concat, which plays them
+   one after another without a gap.
+
+   With crossfade, concat is replaced by audiomixer. The next track is
+   attached shortly before the current one ends, offset to start at
+   the current output time, and the playback thread moves the volume
+   of both inputs with fade().
+
+   How much audio is kept in front of the device is set by a latency
+   profile, PLAYER_LATENCY: the queue's length and the buffer-time and
+   latency-time of the audio sink (or of the one autoaudiosink picks).
+   Longer buffers ride out a busy machine, shorter ones make pause,
+   resume and seeks take effect sooner.
+
+   Everything here except the probes, latencyStats() and underruns() is used
+   from the playback thread only
+   */
+namespace output
+{
+    // element used for audio output, autoaudiosink unless PLAYER_AUDIO_SINK is set.
+    // fakesink makes it possible to run playback without a sound card
+    // "ao" is not an element, it plays through libao (see ao_output.hpp)
+    extern std::string audioSink;
+
+    // overlap between tracks in nanoseconds, 0 means gapless playback.
+    // set from PLAYER_CROSSFADE (in seconds) by init()
+    extern gint64 crossfade;
+    bool crossfadeEnabled();
+
+    struct LatencyProfile
+    {
+        const char* name;
+        // the audio sink's ring buffer and the size of the segments
+        // it is written in, microseconds like the sink properties
+        gint64 bufferTime;
+        gint64 latencyTime;
+        // most the queue holds, nanoseconds
+        gint64 queueTime;
+    };
+    // low-latency, balanced or robust, set from PLAYER_LATENCY by init().
+    // balanced keeps the sink's defaults
+    extern const LatencyProfile* latencyProfile;
+
+    struct LatencyStats
+    {
+        const char* profile = "";
+        // audio between the converters and the device, nanoseconds.
+        // what is in the queue and the latency the pipeline reports
+        // (the sink's buffer-time until it does), or the libao ring
+        gint64   latency = 0;
+        // times the device ran out of audio while playing,
+        // running dry at the end of playback does not count
+        uint64_t underruns = 0;
+        // nanoseconds spent playing since init()
+        gint64   played = 0;
+    };
+    // can be called from any thread between init() and end()
+    LatencyStats latencyStats();
+    // the underruns of latencyStats() alone, without querying the pipeline.
+    // can be called from any thread
+    uint64_t underruns();
+
+    // the sink is named "sink", whatever element it is
+    extern Glib::RefPtr<Gst::Pipeline> pipeline;
+
+    // called from streaming threads whenever something happens
+    // on the output: a bus message or the end of an attached track.
+    // must be set before init()
+    extern std::function<void()> onEvent;
+    void notify();
+
+    bool init();
+    void end();
+
+    // links the track after everything that is already attached,
+    // it starts playing as soon as the tracks before it finish
+    bool attach(data::OpenedTrack& track);
+    void detach(data::OpenedTrack& track);
+    size_t attachedCount();
+    // how many track sources were built since init(),
+    // a burst of coalesced commands should only add one
+    size_t attachedTotal();
+
+    // stops streaming and drops everything that is buffered,
+    // the sink and converters stay up
+    void reset();
+
+    void play();
+    void pause();
+
+    // pops everything from the bus, logs errors and warnings.
+    // returns false if the pipeline reached EOS, or the current track
+    // or the output's own elements failed. an error from another attached
+    // track (the next one, or the one fading in) only marks that track,
+    // the playback thread detaches it when it sees failed()
+    bool processMessages(const data::OpenedTrack& current);
+    // true if the track is attached and something inside its bin failed
+    bool failed(const data::OpenedTrack& track);
+
+    bool queryPosition(const data::OpenedTrack& track, gint64& position);
+    bool queryDuration(const data::OpenedTrack& track, gint64& duration);
+
+    // 0 is only the oldest attached track audible, 1 only the newest
+    void fade(double progress);
+
+    // flushing seek in whatever is playing now. key unit seeks land on
+    // the nearest point the decoder can start from, which is a lot cheaper
+    // for compressed formats; accurate ones decode up to the exact position
+    bool seek(const data::OpenedTrack& track, gint64 position, bool accurate);
+
+    // starts measuring a track switch that someone is waiting for,
+    // latency and CPU time until the first buffer reaches the sink are logged
+    void markSwitch(const char* name = "Track switch");
+}
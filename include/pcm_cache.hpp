@@ -0,0 +1,72 @@
+#pragma once
+
+#include "data.hpp"
+
+#include <gstreamermm.h>
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+   Decoded audio of the tracks that were played last, kept in memory.
+
+   While a track plays, the buffers that leave its bin are copied
+   into a recording. If the track plays to the end the recording becomes
+   a cache entry, and the next time the track is opened (previous,
+   replaying a list) an appsrc serves it with the original timestamps
+   instead of reading and decoding the file.
+
+   A recording that is cut short (the track is skipped, seeked or
+   is too long) keeps the beginning up to there. When the track is
+   opened again that part plays from memory while the file is decoded
+   behind it, and the track switches to the file where the cache ends
+   (see data::OpenedTrack).
+
+   Audio is copied into blocks of 256 KiB, so a recording never has to
+   be moved while it grows, and memory is counted as blocks are allocated.
+   Entries are dropped least recently used first once they take more
+   memory than the limit, recordings that are still running count
+   against it too. A source that is playing an entry keeps it alive
+   after it is dropped.
+
+   Limits are in MiB and set through the environment:
+   PLAYER_PCM_CACHE for everything (0 turns the cache off),
+   PLAYER_PCM_CACHE_TRACK for a single track, longer ones are not kept
+   */
+namespace pcmcache
+{
+    // bytes of decoded audio kept in total, 0 turns the cache off
+    extern size_t memoryLimit;
+    // bytes of decoded audio kept of a single track
+    extern size_t trackLimit;
+
+    struct Stats
+    {
+        // tracks that started from memory and tracks that had to be decoded,
+        // counted when they start playing, not when they are prerolled
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+
+        size_t tracks = 0;
+        size_t bytes = 0;
+    };
+
+    // reads the limits from the environment
+    void init();
+    void end();
+
+    bool enabled();
+
+    // source that plays the cached audio of the track, empty if it is not cached.
+    // cachedUntil is where the cached audio ends if only the beginning
+    // of the track is kept, Gst::CLOCK_TIME_NONE if all of it is
+    Glib::RefPtr<Gst::Element> createSource(uint64_t trackId, guint64& cachedUntil);
+
+    // starts keeping what the track decodes, does nothing if all of it is played from the cache
+    void record(data::OpenedTrack& track);
+
+    // counts a hit or a miss, called when the track starts playing
+    void started(const data::OpenedTrack& track);
+
+    Stats stats();
+}
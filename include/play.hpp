@@ -3,29 +3,24 @@
 #include "data.hpp"
 #include "playlist.hpp"
 #include "options.hpp"
+#include "mpsc_queue.hpp"
+#include "seqlock.hpp"
+#include "playback_queue.hpp"
 
-#include <queue>
 #include <list>
 #include <memory>
 #include <mutex>
+#include <functional>
 #include <initializer_list>
+#include <cstdint>
 
 namespace playback
 {
-    class Command;
-    class CommandPAUSE;
-    class CommandRESUME;
-    class CommandTOGGLE;
-    class CommandSTOP;
-    class CommandSTOPALL;
-    class CommandPREVIOUS;
-    class CommandNEXT;
-    class CommandEXIT;
-    class CommandPLAY;
-
     enum class PlaybackOption
     {
         shuffle,
+        // with shuffle, avoid playing the same artist twice in a row
+        spreadArtists,
         stopCurrentPlayback,
         suspendCurrentPlayback,
         playAfterCurrentList,
@@ -35,47 +30,9 @@ namespace playback
 
     using PlaybackOptions = Options<PlaybackOption>;
 
-    /*
-       commands are processed in two functions: 
-       playbackThreadWait() and processPlaybackCommand()
-
-       playbackThreadWait() processes everything in place, when
-       processPlaybackCommand() can throw commandID (mainly of commands
-       that stop current playback) so that it could be processed by
-       upper(?) function, which is playbackThread()
-       */
-    extern std::queue<std::unique_ptr<Command>>     playbackControl;
-    extern std::mutex playbackControlMutex;
-    extern bool playbackPause;
-    extern std::thread playbackThread;
-
-    namespace NowPlaying
-    {
-        extern std::shared_ptr<data::Track> track;
-        extern bool playing;
-        extern gint64 duration;
-        extern gint64 current;
-
-        void reset();
-    }
-
-
-    void init();
-    void end();
-    std::unique_ptr<Command> playTrack(data::OpenedTrack& track);
-    void startPlayback(std::shared_ptr<data::Artist> artist, PlaybackOptions options);
-    void startPlayback(std::shared_ptr<data::Album> album, PlaybackOptions options);
-    void startPlayback(std::shared_ptr<data::Track> track, PlaybackOptions options );
-    void startPlayback(std::shared_ptr<Playlist> playlist, PlaybackOptions options);
-    std::unique_ptr<CommandPLAY> playbackThreadWait();
-    void playbackThreadFunc();
-    std::unique_ptr<Command> getPlaybackCommand();
-    void sendPlaybackCommand(Command* command);
-    bool playbackInProcess();
-
-
     enum class CommandType
     {
+        none,
         pause,
         resume,
         toggle,
@@ -84,78 +41,122 @@ namespace playback
         previous,
         next,
         exit,
-        play
+        play,
+        seek,
+        jump
     };
 
-    // SIMPLE COMMANDS
-    class Command
+    // Commands are plain values moved through playbackControl,
+    // so sending one does not allocate (except for the track list of play,
+    // an artist or album is sent as it is and only listed by the playback thread)
+    struct Command
     {
-        const CommandType commandType;
+        CommandType type = CommandType::none;
 
-        protected:
-        Command(CommandType commandType);
+        // next and previous only: how many tracks to skip
+        unsigned count = 1;
 
-        public:
+        // jump only: position in the queue snapshot
+        size_t index = 0;
 
-        CommandType type() const;
-        virtual ~Command();
-    };
+        // seek only: nanoseconds, from the current position if relative
+        gint64 seekTo = 0;
+        bool seekRelative = true;
+        bool seekAccurate = false;
 
-    class CommandPAUSE : public Command
-    {
-        public:
-            CommandPAUSE() : Command(CommandType::pause) {};
-    };
+        // play only. the tracks of artist or album are added
+        // to tracks when the playback thread takes the command
+        std::list<std::shared_ptr<data::Track>> tracks;
+        std::shared_ptr<data::Artist> artist;
+        std::shared_ptr<data::Album> album;
+        PlaybackOptions options = {};
 
-    class CommandRESUME : public Command
-    {
-        public:
-            CommandRESUME() : Command(CommandType::resume) {};
-    };
+        Command() {}
+        Command(CommandType type) : type(type) {}
 
-    class CommandTOGGLE : public Command
-    {
-        public:
-            CommandTOGGLE() : Command(CommandType::toggle) {};
+        static Command play(std::list<std::shared_ptr<data::Track>> tracks, PlaybackOptions options);
+        static Command seek(gint64 position, bool relative, bool accurate);
+        static Command jump(size_t index);
     };
 
-    class CommandSTOP : public Command
-    {
-        public:
-            CommandSTOP() : Command(CommandType::stop) {};
-    };
+    /*
+       commands go through playbackControl, a lock-free MpscQueue:
+       sendPlaybackCommand() pushes from any thread and wakes the
+       playback thread, which takes everything out with getPlaybackCommand().
+
+       while a track plays, playTrack() handles pause, resume and seeks
+       in place and returns everything else to playbackThreadFunc(),
+       which changes the queue. with nothing to play playbackThreadWait()
+       waits for a play (or exit)
+       */
+    extern MpscQueue<Command> playbackControl;
+    extern std::thread playbackThread;
 
-    class CommandSTOPALL : public Command
+    enum class PlaybackState
     {
-        public:
-            CommandSTOPALL() : Command(CommandType::stopAll) {};
+        stopped,
+        playing,
+        paused
     };
 
-    class CommandPREVIOUS : public Command
+    // what is playing right now, as seen from other threads.
+    // the playback thread publishes a new one whenever something changes
+    struct NowPlayingSnapshot
     {
-        public:
-            CommandPREVIOUS() : Command(CommandType::previous) {};
+        // tracks belong to the library, which outlives playback
+        const data::Track* track = nullptr;
+        uint64_t trackId = 0;
+
+        gint64 position = 0;
+        gint64 duration = 0;
+        PlaybackState state = PlaybackState::stopped;
+
+        // tracks left after the current one, not counting suspended playback
+        size_t queueLength = 0;
+        // position of the current track in queue(), which is
+        // not published again when only this changes
+        size_t queueIndex = 0;
     };
 
-    class CommandNEXT : public Command
-    {
-        public:
-            CommandNEXT() : Command(CommandType::next) {};
-    };
+    // lock-free, never blocks the playback thread
+    NowPlayingSnapshot nowPlaying();
 
-    class CommandEXIT : public Command
-    {
-        public:
-            CommandEXIT() : Command(CommandType::exit) {};
-    };
+    // what is going to be played, only changes when the tracks in the queue do.
+    // the current one is nowPlaying().queueIndex
+    std::shared_ptr<const PlaybackQueue::Snapshot> queue();
 
-    // PLAYBACK COMMAND
-    class CommandPLAY : public Command
-    {
-        public:
-            CommandPLAY(const std::list<std::shared_ptr<data::Track>>& tracks, PlaybackOptions options); //TODO: remove const reference so that it is possible to use move
 
-            std::list<std::shared_ptr<data::Track>> tracks;
-            PlaybackOptions options;
-    };
+    void init();
+    void end();
+    // attachNext is called when the next track should be attached to the output:
+    // right after the start for gapless playback, or when the crossfade begins.
+    // dropFailed is called whenever bus messages were processed, to detach
+    // a next track that failed before it was heard (see output::failed()).
+    // returns a command of type none if the track has ended
+    Command playTrack(data::OpenedTrack& track, const std::function<void()>& attachNext = {},
+            const std::function<void()>& dropFailed = {});
+    void startPlayback(std::shared_ptr<data::Artist> artist, PlaybackOptions options);
+    void startPlayback(std::shared_ptr<data::Album> album, PlaybackOptions options);
+    void startPlayback(std::shared_ptr<data::Track> track, PlaybackOptions options );
+    void startPlayback(std::shared_ptr<Playlist> playlist, PlaybackOptions options);
+    // returns false if received exit
+    bool playbackThreadWait(Command& play);
+    void playbackThreadFunc();
+    // takes everything that has been sent so far and merges commands
+    // that follow each other: N nexts become one skip of N (and N previous
+    // one skip back, a change of direction is a command of its own),
+    // an even number of toggles disappears, repeated seeks end up
+    // as one seek to where they would have got together, a play that
+    // is followed by one that replaces everything is dropped.
+    // returns false if there are no commands
+    bool getPlaybackCommand(Command& command);
+    // does not block as long as there is room in playbackControl.
+    // when it is full (the playback thread has been stuck for 1024 commands)
+    // it yields until there is, so that no command is lost
+    void sendPlaybackCommand(Command command);
+
+    // the playback thread sleeps until it is woken up by a command or an output event.
+    // while a track is playing it also wakes up to refresh its position
+    void wakePlaybackThread();
+    bool playbackInProcess();
 }
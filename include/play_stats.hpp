@@ -0,0 +1,71 @@
+#pragma once
+
+#include "data.hpp"
+
+#include <gstreamermm.h>
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/*
+   Numbers on how each track played, for when playback stutters.
+
+   A track is measured from when it is attached to the output:
+   how long its bin takes to reach PAUSED and PLAYING and until the
+   first decoded buffer leaves it. While it is the current track the
+   output's underruns (see output::latencyStats()), QoS messages,
+   errors and warnings are counted against it. Errors and warnings
+   from inside a track's bin go to that track even if it is not
+   current yet.
+
+   The streaming thread only reads its own CPU clock once per buffer
+   and adds to a few atomics, everything else happens on bus messages
+   in the playback thread, so this is always on.
+
+   When a track is detached its numbers are logged and kept with the
+   last few tracks. The current track's numbers are logged every
+   PLAYER_STATS_INTERVAL seconds while it plays, 60 by default,
+   0 turns that off
+   */
+namespace playstats
+{
+    struct TrackStats
+    {
+        uint64_t    trackId = 0;
+        std::string filepath;
+
+        // nanoseconds since the track was attached, -1 if it has not happened
+        gint64 toPaused = -1;
+        gint64 toPlaying = -1;
+        gint64 firstBuffer = -1;
+
+        uint64_t underruns = 0;
+        uint64_t qosMessages = 0;
+        uint64_t errors = 0;
+        uint64_t warnings = 0;
+
+        // CPU time of the streaming threads that push decoded audio
+        // out of the track, which is where decoding happens
+        gint64 decoderCpu = 0;
+    };
+
+    // reads the interval from the environment
+    void init();
+
+    // called by the output from the playback thread
+    void attached(data::OpenedTrack& track);
+    void detached(data::OpenedTrack& track);
+    void message(const Glib::RefPtr<Gst::Message>& message);
+
+    // called by the playback thread when the track becomes the one that
+    // is heard, and while it plays to log its numbers when it is time
+    void current(const data::OpenedTrack& track);
+    void tick();
+
+    // can be called from any thread.
+    // returns false if nothing is playing
+    bool currentStats(TrackStats& stats);
+    // tracks that were detached last, oldest first
+    std::vector<TrackStats> recent();
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include "data.hpp"
+#include "indexed_sequence.hpp"
+#include "shuffle.hpp"
+
+#include <list>
+#include <vector>
+#include <memory>
+#include <random>
+#include <unordered_map>
+#include <cstddef>
+#include <cstdint>
+
+/*
+   Everything the playback thread is going to play, and what it has played.
+
+   Tracks live in frames. A frame is one timeline: the tracks that were
+   already played, the current one and the upcoming ones, in a single
+   IndexedSequence, so any track can be looked up, inserted, removed
+   or jumped to by its position. Tracks that were enqueued together
+   form a list inside the frame, which is what "after the current list"
+   refers to.
+
+   A list can be shuffled. Its tracks stay in the order they were
+   enqueued and a Shuffle maps play positions to them, so shuffling
+   a whole library costs nothing up front. A list that is shuffled
+   is only put in play order for real if tracks are inserted into it
+   or removed from it.
+
+   Suspending playback pushes a new frame on top of the current one,
+   when the top frame runs out or is stopped the one below resumes
+   from the track that was interrupted. Frames are moved, not copied.
+
+   Played tracks are kept for previous and jump, but only the last
+   playedLimit or so: lists that were played completely before
+   those are dropped as a whole (a shuffled list stays shuffled).
+
+   Only the playback thread uses it, other threads get snapshots
+   */
+class PlaybackQueue
+{
+    public:
+    using TrackList = std::list<std::shared_ptr<data::Track>>;
+
+    enum class Order
+    {
+        asGiven,
+        shuffled,
+        // shuffled, and the same artist does not play twice in a row
+        // if there is another one close enough to take its place
+        shuffledSpreadArtists
+    };
+
+    // the current track is not part of it, moving it does not
+    // change the tracks, see currentIndex() and version()
+    struct Snapshot
+    {
+        // the top frame, played tracks included.
+        // tracks belong to the library, which outlives playback
+        std::vector<const data::Track*> tracks;
+        // frames waiting under the top one
+        size_t suspended = 0;
+    };
+
+    PlaybackQueue();
+
+    // nothing left to play in any frame
+    bool empty() const;
+
+    // nullptr if empty()
+    std::shared_ptr<data::Track> current() const;
+    size_t currentIndex() const;
+
+    // tracks of the top frame, played ones included
+    size_t size() const;
+    const std::shared_ptr<data::Track>& at(size_t index) const;
+
+    // tracks after the current one in the top frame
+    size_t remaining() const;
+    // up to count tracks that follow the current one in the top frame
+    std::vector<std::shared_ptr<data::Track>> upcoming(size_t count) const;
+
+    // these move the current track, a frame that runs out
+    // is dropped and the one under it resumes
+    void advance(size_t count = 1);
+    void back(size_t count = 1);
+    void jump(size_t index);
+
+    // drops everything, including suspended frames, and plays tracks
+    void replace(TrackList tracks, Order order = Order::asGiven);
+    // keeps the current frame for later and plays tracks in a new one
+    void suspend(TrackList tracks, Order order = Order::asGiven);
+
+    void insertAfterCurrent(TrackList tracks, Order order = Order::asGiven);
+    void insertAfterCurrentList(TrackList tracks, Order order = Order::asGiven);
+    void append(TrackList tracks, Order order = Order::asGiven);
+
+    void insert(size_t index, std::shared_ptr<data::Track> track);
+    void remove(size_t index);
+
+    // drops the top frame, the one under it resumes
+    void stop();
+    void clear();
+
+    // changes every time the tracks of the top frame or their order do.
+    // moving the current track inside the frame does not count
+    uint64_t version() const;
+    Snapshot snapshot() const;
+
+    private:
+    using Tracks = IndexedSequence<std::shared_ptr<data::Track>>;
+
+    struct List
+    {
+        size_t size = 0;
+
+        bool shuffled = false;
+        bool spreadArtists = false;
+        Shuffle order;
+        // play positions that were exchanged to spread artists out,
+        // they override order
+        std::unordered_map<size_t, size_t> swapped;
+    };
+
+    struct Frame
+    {
+        Tracks tracks;
+        size_t current = 0;
+        // the lists the tracks came in, in order
+        std::vector<List> lists;
+    };
+
+    // the last one is playing, the ones before it are suspended
+    std::vector<Frame> frames;
+    uint64_t changes = 0;
+
+    std::mt19937_64 random;
+
+    // how far ahead a track by another artist is looked for
+    static const size_t spreadDistance = 64;
+    // played tracks that are kept at least
+    static const size_t playedLimit = 1000;
+
+    Frame& top();
+    const Frame& top() const;
+
+    // index of the list that holds the track at index
+    size_t listOf(size_t index) const;
+    size_t listStart(size_t list) const;
+    size_t listEnd(size_t list) const;
+
+    // where the track that plays at index is kept
+    size_t storageIndex(size_t index) const;
+    const std::shared_ptr<data::Track>& trackAt(size_t index) const;
+
+    List makeList(size_t size, Order order);
+    Tracks makeTracks(TrackList tracks);
+    void insertTracks(size_t index, Tracks tracks);
+    // stores a shuffled list in play order, so that it can be changed
+    void materialize(size_t list);
+    // keeps the next track from being by the same artist as the current one
+    void spreadArtists();
+    void dropFinishedFrames();
+    // drops whole lists that were played before the last playedLimit tracks
+    void trimPlayed();
+};
@@ -1,12 +1,17 @@
 #pragma once
 
 #include "data.hpp"
+#include "indexed_sequence.hpp"
 
 #include <list>
 #include <vector>
+#include <unordered_map>
 #include <initializer_list>
 #include <memory>
 #include <string>
+#include <chrono>
+#include <atomic>
+#include <ctime>
 
 class Playlist;
 class SimplePlaylist;
@@ -16,6 +21,8 @@ class Condition;
 class NameCondition; 
 class AlbumNameCondition;
 class ArtistNameCondition;
+class PlayCountCondition;
+class NotPlayedForCondition;
 class LogicalCondition;
 class AND_Condition;
 class OR_Condition;
@@ -33,16 +40,33 @@ class Playlist
 };
 
 
+// Tracks are stored in an IndexedSequence, and every track knows
+// the handles of all its entries, so membership is O(1)
+// and removing or moving by track or by position is O(log n)
 class SimplePlaylist : public Playlist
 {
-    std::list<std::shared_ptr<data::Track>> tracks;
+    using Entries = IndexedSequence<std::shared_ptr<data::Track>>;
+
+    Entries tracks;
+    std::unordered_map<const data::Track*, std::vector<Entries::Handle>> entries;
 
     public:
     SimplePlaylist(const std::string& name);
     SimplePlaylist(const std::string& name, const std::list<std::shared_ptr<data::Track>>& tracks);
 
     void addTrack(std::shared_ptr<data::Track> track);
+    void insertTrack(size_t pos, std::shared_ptr<data::Track> track);
+    // removes the first entry of the track
     void removeTrack(std::shared_ptr<data::Track> track);
+    void removeAt(size_t pos);
+    void moveTrack(size_t from, size_t to);
+
+    bool contains(const std::shared_ptr<data::Track>& track) const;
+    std::vector<size_t> positionsOf(const std::shared_ptr<data::Track>& track) const;
+
+    size_t size() const;
+    // O(log n), safe to call from several threads while nobody modifies the playlist
+    const std::shared_ptr<data::Track>& trackAt(size_t pos) const;
 
     virtual std::list<std::shared_ptr<data::Track>> getTracks() const override;
     virtual void testPrint() const override;
@@ -54,6 +78,10 @@ class Condition
 {
     public:
 	virtual bool check(const std::shared_ptr<data::Track>& tracks) const = 0;
+
+    // called once before the library is checked,
+    // conditions that depend on the current time read the clock here
+    virtual void startEvaluation() const {}
 };
 
 
@@ -90,6 +118,42 @@ class ArtistNameCondition : public Condition
 };
 
 
+// uses play counts from history, O(1) per track
+class PlayCountCondition : public Condition
+{
+    public:
+    enum class Comparison
+    {
+        less,
+        equal,
+        greater
+    };
+
+    PlayCountCondition(Comparison comparison, unsigned count);
+
+    virtual bool check(const std::shared_ptr<data::Track>& tracks) const override;
+
+    private:
+    Comparison comparison;
+    unsigned count;
+};
+
+
+// true for tracks that have not been played in the given period, including ones never played
+class NotPlayedForCondition : public Condition
+{
+    std::chrono::seconds period;
+    // tracks last played before this match, set by startEvaluation()
+    mutable std::atomic<std::time_t> cutoff;
+
+    public:
+    NotPlayedForCondition(std::chrono::seconds period);
+
+    virtual bool check(const std::shared_ptr<data::Track>& tracks) const override;
+    virtual void startEvaluation() const override;
+};
+
+
 class LogicalCondition : public Condition
 {
     protected:
@@ -97,6 +161,8 @@ class LogicalCondition : public Condition
 
     public:
     LogicalCondition(std::vector<std::unique_ptr<Condition>> conditions);
+
+    virtual void startEvaluation() const override;
 };
 
 
@@ -116,6 +182,8 @@ class OR_Condition : public LogicalCondition
 
 
 // SMART PLAYLIST
+// Conditions are evaluated in parallel over chunks of the library,
+// so Condition::check must be safe to call from several threads at once
 class SmartPlaylist : public Playlist
 {
     std::unique_ptr<Condition> condition;
@@ -123,6 +191,10 @@ class SmartPlaylist : public Playlist
     public:
     SmartPlaylist(const std::string& name, std::unique_ptr<Condition> condition);
 
+    // 0 means one thread per hardware core
+    static void setThreadCount(size_t count);
+    static size_t getThreadCount();
+
     virtual std::list<std::shared_ptr<data::Track>> getTracks() const override;
     virtual void testPrint() const override;
 };
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "playlist.hpp"
+
+#include <istream>
+#include <ostream>
+#include <memory>
+#include <string>
+
+/*
+   Reading and writing SimplePlaylist to disk.
+
+   Entries are resolved against the library through data::findTrack,
+   entries that are not in the library are skipped.
+   Everything goes through SimplePlaylist::addTrack and SimplePlaylist::getTracks
+   */
+namespace playlistio
+{
+    enum class PlaylistFormat
+    {
+        m3u,    // also m3u8, which is the same thing in utf-8
+        pls,
+        binary, // our own compact format, see playlist_io.cpp
+        unknown
+    };
+
+    PlaylistFormat formatFromPath(const std::string& path);
+
+    struct ImportResult
+    {
+        size_t added   = 0;
+        size_t missing = 0;
+        bool   ok      = true;
+        // the name stored in the file, only the binary format has one
+        std::string name;
+    };
+
+    // relative entries are resolved against baseDir
+    ImportResult importPlaylist(std::istream& in, PlaylistFormat format, const std::string& baseDir, SimplePlaylist& playlist);
+    bool exportPlaylist(std::ostream& out, PlaylistFormat format, const SimplePlaylist& playlist);
+
+    // format is chosen by file extension. the playlist is named after the file,
+    // unless it is a binary one, which keeps its name
+    std::shared_ptr<SimplePlaylist> loadPlaylist(const std::string& path);
+    bool savePlaylist(const std::string& path, const SimplePlaylist& playlist);
+}
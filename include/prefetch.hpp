@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+/*
+   Warms the page cache for tracks that are about to be played.
+
+   On slow or network mounted libraries the first read of a file
+   can take long enough to be heard. The playback thread tells
+   which files come next, and a background thread reads the beginning
+   of each of them ahead of time with readahead(2), within a byte budget
+   */
+namespace prefetch
+{
+    // how many upcoming tracks are kept warm
+    extern size_t lookahead;
+    // only the beginning of a file is read ahead, the rest is left to the source
+    extern size_t bytesPerTrack;
+    // bytes per second prefetching may read, 0 means unlimited
+    extern size_t ioBudget;
+
+    void start();
+    void end();
+
+    // replaces the files to prefetch, in the order they will be played.
+    // files that were prefetched recently are not read again.
+    // does not block
+    void upcoming(std::vector<std::string> paths);
+}
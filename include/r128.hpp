@@ -0,0 +1,211 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+/*
+   Integrated loudness and sample peak of interleaved float audio,
+   as in EBU R128 / ITU-R BS.1770.
+
+   Every channel goes through the K-weighting filter (a high shelf and
+   a high pass), mean squares are taken over 400 ms blocks that overlap
+   by 75%, and blocks that are quieter than -70 LUFS or 10 LU below
+   the average of the rest are not counted.
+
+   Filter coefficients are computed for the sample rate the same way
+   libebur128 does, so the audio does not have to be resampled to 48 kHz.
+   Channels are weighted as 5.1 if there are six of them, all other
+   layouts count every channel fully
+   */
+class R128Meter
+{
+    public:
+    R128Meter(unsigned rate, unsigned channels) :
+        channels(channels),
+        subblockFrames(std::max(rate / 10, 1u)),
+        filters(channels),
+        weights(channels, 1.0),
+        subblockSums(channels, 0.0)
+    {
+        const double pi = 3.14159265358979323846;
+
+        double f0 = 1681.974450955533;
+        double gain = 3.999843853973347;
+        double q = 0.7071752369554196;
+        double k = std::tan(pi * f0 / rate);
+        double vh = std::pow(10.0, gain / 20.0);
+        double vb = std::pow(vh, 0.4996667741545416);
+        double a0 = 1.0 + k / q + k * k;
+        shelf = { (vh + vb * k / q + k * k) / a0, 2.0 * (k * k - vh) / a0, (vh - vb * k / q + k * k) / a0,
+                  2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0 };
+
+        f0 = 38.13547087602444;
+        q = 0.5003270373238773;
+        k = std::tan(pi * f0 / rate);
+        a0 = 1.0 + k / q + k * k;
+        highPass = { 1.0, -2.0, 1.0, 2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0 };
+
+        // L, R, C, LFE, Ls, Rs
+        if (channels == 6)
+        {
+            weights = { 1.0, 1.0, 1.0, 0.0, 1.41, 1.41 };
+        }
+    }
+
+    void add(const float* samples, size_t frames)
+    {
+        for (size_t frame = 0; frame < frames; frame++)
+        {
+            for (unsigned channel = 0; channel < channels; channel++)
+            {
+                double sample = samples[frame * channels + channel];
+                samplePeak = std::max(samplePeak, std::fabs(sample));
+
+                Filter& filter = filters[channel];
+                double weighted = filter.second.run(highPass, filter.first.run(shelf, sample));
+                subblockSums[channel] += weighted * weighted;
+            }
+
+            if (++subblockFill == subblockFrames)
+            {
+                endSubblock();
+            }
+        }
+    }
+
+    // LUFS, -inf if everything was gated out
+    double integrated() const
+    {
+        double energy = gatedEnergy();
+        return energy > 0 ? toLoudness(energy) : -HUGE_VAL;
+    }
+
+    // largest absolute sample value, 1.0 is full scale
+    double peak() const
+    {
+        return samplePeak;
+    }
+
+    // 400 ms blocks that passed both gates, weighs tracks against each other in an album
+    uint64_t gatedBlocks() const
+    {
+        uint64_t count = 0;
+        double threshold = relativeThreshold();
+        for (double energy : blocks)
+        {
+            if (energy > threshold)
+            {
+                count++;
+            }
+        }
+        return count;
+    }
+
+    static double toLoudness(double energy)
+    {
+        return -0.691 + 10.0 * std::log10(energy);
+    }
+
+    static double toEnergy(double loudness)
+    {
+        return std::pow(10.0, (loudness + 0.691) / 10.0);
+    }
+
+    private:
+    // b0 b1 b2 a1 a2, a0 is 1
+    struct Coefficients
+    {
+        double b0, b1, b2, a1, a2;
+    };
+
+    // transposed direct form II
+    struct Biquad
+    {
+        double z1 = 0, z2 = 0;
+
+        double run(const Coefficients& c, double in)
+        {
+            double out = c.b0 * in + z1;
+            z1 = c.b1 * in - c.a1 * out + z2;
+            z2 = c.b2 * in - c.a2 * out;
+            return out;
+        }
+    };
+
+    using Filter = std::pair<Biquad, Biquad>;
+
+    unsigned channels;
+    unsigned subblockFrames;
+
+    Coefficients shelf;
+    Coefficients highPass;
+    std::vector<Filter> filters;
+    std::vector<double> weights;
+
+    // 100 ms pieces, a block is the last four of them
+    std::vector<double> subblockSums;
+    unsigned subblockFill = 0;
+    double recent[4] = { 0, 0, 0, 0 };
+    size_t subblockCount = 0;
+
+    // mean square of every block, weighted over channels
+    std::vector<double> blocks;
+    double samplePeak = 0;
+
+    void endSubblock()
+    {
+        double energy = 0;
+        for (unsigned channel = 0; channel < channels; channel++)
+        {
+            energy += weights[channel] * subblockSums[channel] / subblockFrames;
+            subblockSums[channel] = 0;
+        }
+        subblockFill = 0;
+
+        recent[subblockCount++ % 4] = energy;
+        if (subblockCount >= 4)
+        {
+            blocks.push_back((recent[0] + recent[1] + recent[2] + recent[3]) / 4);
+        }
+    }
+
+    double relativeThreshold() const
+    {
+        double absolute = toEnergy(-70.0);
+        double sum = 0;
+        size_t count = 0;
+        for (double energy : blocks)
+        {
+            if (energy > absolute)
+            {
+                sum += energy;
+                count++;
+            }
+        }
+        if (count == 0)
+        {
+            return HUGE_VAL;
+        }
+        // 10 LU below is a tenth of the energy
+        return std::max(absolute, sum / count / 10.0);
+    }
+
+    double gatedEnergy() const
+    {
+        double threshold = relativeThreshold();
+        double sum = 0;
+        size_t count = 0;
+        for (double energy : blocks)
+        {
+            if (energy > threshold)
+            {
+                sum += energy;
+                count++;
+            }
+        }
+        return count ? sum / count : 0;
+    }
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+/*
+   Offline front end: player --render QUERY --out DIR --format FORMAT [--jobs N] FILES...
+
+   Tracks that match the query are decoded the same way as for playback
+   (data::OpenedTrack, without loudness gain) and encoded into files under
+   DIR/artist/album/, tracks that would get the same name there
+   are numbered: "name (2).opus". Every worker of a pool runs one pipeline at a time,
+   without a clock, so a track takes as long as decoding and encoding it does.
+
+   QUERY is artist:NAME or album:NAME for an exact name, all for everything,
+   or a string that is looked for in the artist, album and track names and in the path.
+   FORMAT is opus, vorbis, flac, mp3 or wav.
+
+   Progress is printed once a second, with how many times faster than
+   realtime all workers together are going
+   */
+namespace render
+{
+    struct Options
+    {
+        std::string query;
+        std::string outDir;
+        std::string format = "opus";
+        // 0 means one per hardware core
+        size_t jobs = 0;
+    };
+
+    // returns false if anything could not be rendered
+    bool run(const Options& options);
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/*
+   Value with one writer and any number of readers that never block it.
+
+   The writer makes the sequence number odd, writes, and makes it even again.
+   A reader copies the value and retries if the sequence number
+   was odd or has changed while it was copying.
+
+   The value itself is kept in atomic words so that a copy torn
+   by a concurrent store is only a wrong value to throw away,
+   not a data race. That is also why T has to be trivially copyable.
+   */
+template< typename T >
+class Seqlock
+{
+    static_assert(std::is_trivially_copyable<T>::value, "Seqlock needs a trivially copyable type");
+
+    static const size_t wordCount = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    public:
+    Seqlock(const T& value = T())
+    {
+        uint64_t buffer[wordCount] = {};
+        std::memcpy(buffer, &value, sizeof(T));
+        for (size_t i = 0; i < wordCount; i++)
+        {
+            words[i].store(buffer[i], std::memory_order_relaxed);
+        }
+    }
+
+    Seqlock(const Seqlock&) = delete;
+    Seqlock& operator= (const Seqlock&) = delete;
+
+    // must only be called from one thread at a time
+    void store(const T& value)
+    {
+        uint64_t buffer[wordCount] = {};
+        std::memcpy(buffer, &value, sizeof(T));
+
+        uint64_t seq = sequence.load(std::memory_order_relaxed);
+        sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (size_t i = 0; i < wordCount; i++)
+        {
+            words[i].store(buffer[i], std::memory_order_relaxed);
+        }
+
+        sequence.store(seq + 2, std::memory_order_release);
+    }
+
+    T load() const
+    {
+        uint64_t buffer[wordCount];
+        while (true)
+        {
+            uint64_t before = sequence.load(std::memory_order_acquire);
+            if (before & 1)
+            {
+                continue;
+            }
+
+            for (size_t i = 0; i < wordCount; i++)
+            {
+                buffer[i] = words[i].load(std::memory_order_relaxed);
+            }
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence.load(std::memory_order_relaxed) == before)
+            {
+                break;
+            }
+        }
+
+        T ret;
+        std::memcpy(&ret, buffer, sizeof(T));
+        return ret;
+    }
+
+    // changes on every store, readers can use it to skip redrawing
+    uint64_t version() const
+    {
+        return sequence.load(std::memory_order_acquire) / 2;
+    }
+
+    private:
+    std::atomic<uint64_t> sequence{ 0 };
+    std::atomic<uint64_t> words[wordCount];
+};
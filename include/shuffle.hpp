@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+   Random permutation of 0..size-1 that is never stored.
+
+   The i-th element is computed when it is asked for: a small Feistel
+   network is a bijection on 0..4^k-1 for any key, and values that fall
+   outside of the range are fed through it again until they land inside
+   ("cycle walking"), which keeps it a bijection on 0..size-1.
+
+   So setting it up is O(1) whatever the size, and shuffling again
+   only means picking another seed
+   */
+class Shuffle
+{
+    public:
+    Shuffle(size_t size = 0, uint64_t seed = 0) :
+        count(size),
+        key(seed)
+    {
+        while ((uint64_t(1) << (2 * halfBits)) < count)
+        {
+            halfBits++;
+        }
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    // where the i-th element of the shuffled order is in the original one
+    size_t operator[] (size_t index) const
+    {
+        // 4^k is less than 4 * size, so this takes a few rounds at most on average
+        uint64_t value = index;
+        do
+        {
+            value = permute(value);
+        }
+        while (value >= count);
+        return value;
+    }
+
+    private:
+    uint64_t count;
+    uint64_t key;
+    unsigned halfBits = 1;
+
+    static const int rounds = 4;
+
+    uint64_t permute(uint64_t value) const
+    {
+        uint64_t mask = (uint64_t(1) << halfBits) - 1;
+        uint64_t left = value >> halfBits;
+        uint64_t right = value & mask;
+
+        for (int round = 0; round < rounds; round++)
+        {
+            uint64_t next = left ^ (mix(right ^ (key + round * 0x9e3779b97f4a7c15ull)) & mask);
+            left = right;
+            right = next;
+        }
+
+        return (left << halfBits) | right;
+    }
+
+    // splitmix64 finalizer
+    static uint64_t mix(uint64_t x)
+    {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ull;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebull;
+        x ^= x >> 31;
+        return x;
+    }
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+
+/*
+   Bounded lock-free byte queue for one producer and one consumer.
+
+   head is only written by the producer and tail only by the consumer,
+   both count bytes since the start and are reduced to a position
+   with the mask, so a full ring and an empty one are told apart
+   without wasting a byte. Each side reads the other's counter
+   with acquire and publishes its own with release.
+
+   write() may only be called from one thread, read() and discard() from one other thread
+   */
+class SpscRing
+{
+    public:
+    // capacity is rounded up to a power of two
+    explicit SpscRing(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity)
+        {
+            size *= 2;
+        }
+
+        mask = size - 1;
+        data.reset(new unsigned char[size]);
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator= (const SpscRing&) = delete;
+
+    // copies as much as fits, returns how much that was
+    size_t write(const void* source, size_t size)
+    {
+        size_t writePos = head.load(std::memory_order_relaxed);
+        size_t readPos  = tail.load(std::memory_order_acquire);
+        size = std::min(size, capacity() - (writePos - readPos));
+
+        size_t offset = writePos & mask;
+        size_t first  = std::min(size, capacity() - offset);
+        std::memcpy(data.get() + offset, source, first);
+        std::memcpy(data.get(), static_cast<const unsigned char*>(source) + first, size - first);
+
+        head.store(writePos + size, std::memory_order_release);
+        return size;
+    }
+
+    // copies out as much as there is, up to size, returns how much that was
+    size_t read(void* destination, size_t size)
+    {
+        size_t readPos  = tail.load(std::memory_order_relaxed);
+        size_t writePos = head.load(std::memory_order_acquire);
+        size = std::min(size, writePos - readPos);
+
+        size_t offset = readPos & mask;
+        size_t first  = std::min(size, capacity() - offset);
+        std::memcpy(destination, data.get() + offset, first);
+        std::memcpy(static_cast<unsigned char*>(destination) + first, data.get(), size - first);
+
+        tail.store(readPos + size, std::memory_order_release);
+        return size;
+    }
+
+    // drops everything that has been written so far, consumer side
+    void discard()
+    {
+        tail.store(head.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    // bytes waiting to be read, exact only on the consumer side
+    size_t size() const
+    {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const
+    {
+        return mask + 1;
+    }
+
+    private:
+    std::unique_ptr<unsigned char[]> data;
+    size_t mask;
+
+    // on separate cache lines, the two sides write them all the time
+    alignas(64) std::atomic<size_t> head{ 0 };
+    alignas(64) std::atomic<size_t> tail{ 0 };
+};
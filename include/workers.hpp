@@ -0,0 +1,43 @@
+#pragma once
+
+#include <functional>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <deque>
+#include <vector>
+#include <cstddef>
+
+// Fixed-size pool of worker threads executing queued jobs in FIFO order
+class WorkerPool
+{
+    public:
+    // 0 threads means one per hardware core
+    WorkerPool(size_t threadCount = 0);
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator= (const WorkerPool&) = delete;
+
+    void submit(std::function<void()> job);
+
+    // splits [0, count) into chunks of at most chunkSize elements,
+    // runs them on the pool and blocks until all of them are done.
+    // called from one of the pool's own workers the chunks run in place:
+    // once every worker waits for jobs queued behind itself nothing runs them
+    void parallelFor(size_t count, size_t chunkSize, const std::function<void(size_t begin, size_t end)>& func);
+
+    size_t size() const;
+
+    ~WorkerPool();
+
+    static size_t defaultThreadCount();
+
+    private:
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> jobs;
+    std::mutex jobsMutex;
+    std::condition_variable jobsCondition;
+    bool stopping = false;
+
+    void workerFunc();
+};
@@ -0,0 +1,326 @@
+#include "ao_output.hpp"
+#include "spsc_ring.hpp"
+#include "log.hpp"
+
+#include <ao/ao.h>
+
+#include <memory>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+using namespace chrono;
+
+namespace aooutput
+{
+    namespace
+    {
+        const int rate = 44100;
+        const int channels = 2;
+        const size_t bytesPerFrame = channels * 2;
+
+        // what the output thread hands to ao_play at once
+        const size_t periodBytes = rate / 100 * bytesPerFrame;
+
+        // how long the streaming thread sleeps at most while the ring is full,
+        // the output thread wakes it earlier when it takes something out
+        const milliseconds fullWait(5);
+
+        ao_device*          device = nullptr;
+        // the null driver takes everything at once, so the output thread keeps the pace of a device
+        bool                paced = false;
+        // nothing is heard from a file, running dry there is not an underrun
+        bool                toFile = false;
+        unique_ptr<SpscRing> ring;
+
+        thread              outputThread;
+        atomic<bool>        stopping{ false };
+        atomic<bool>        playing{ false };
+        // set while the pipeline flushes, the streaming thread must not wait then
+        atomic<bool>        flushing{ false };
+        // the output thread empties the ring, it is the only one that may
+        atomic<bool>        discardRequested{ false };
+        // set at EOS, what is left in the ring is played even if it is not a full period
+        atomic<bool>        draining{ false };
+
+        atomic<uint64_t>    underruns{ 0 };
+
+        mutex               waitMutex;
+        condition_variable  spaceCondition;
+        condition_variable  dataCondition;
+
+        void outputThreadFunc()
+        {
+            vector<char> period(periodBytes);
+            bool starved = true;
+            // when the next period is due with the null driver
+            steady_clock::time_point due;
+
+            while (!stopping)
+            {
+                if (discardRequested.exchange(false))
+                {
+                    ring->discard();
+                    starved = true;
+                    spaceCondition.notify_one();
+                }
+
+                size_t size = ring->size();
+                if (playing && draining && size > 0 && size < periodBytes)
+                {
+                    // the end of the stream, nothing is going to follow it
+                    ring->read(period.data(), size);
+                    starved = true;
+                    spaceCondition.notify_one();
+                    ao_play(device, period.data(), size);
+                    continue;
+                }
+
+                if (!playing || size < periodBytes)
+                {
+                    // a ring that empties in the middle of playback is heard,
+                    // one that was empty to begin with is just nothing playing,
+                    // nor is one that empties at EOS
+                    if (playing && !starved && !toFile && !draining)
+                    {
+                        // counted only, the playback thread logs it
+                        underruns++;
+                    }
+                    starved = true;
+
+                    unique_lock<mutex> lock(waitMutex);
+                    dataCondition.wait_for(lock, milliseconds(10));
+                    continue;
+                }
+
+                if (starved)
+                {
+                    due = steady_clock::now();
+                }
+                ring->read(period.data(), periodBytes);
+                starved = false;
+                spaceCondition.notify_one();
+
+                ao_play(device, period.data(), periodBytes);
+                if (paced)
+                {
+                    due += microseconds(periodBytes / bytesPerFrame * 1000000 / rate);
+                    this_thread::sleep_until(due);
+                }
+            }
+        }
+
+        // called from the streaming thread
+        Gst::FlowReturn takeSample(Gst::AppSink* sink)
+        {
+            auto sample = sink->pull_sample();
+            auto buffer = sample ? sample->get_buffer() : Glib::RefPtr<Gst::Buffer>();
+            GstMapInfo map;
+            if (!buffer || !gst_buffer_map(buffer->gobj(), &map, GST_MAP_READ))
+            {
+                return Gst::FLOW_OK;
+            }
+
+            const guint8* data = map.data;
+            size_t remaining = map.size;
+            while (remaining > 0 && !flushing && !stopping)
+            {
+                size_t written = ring->write(data, remaining);
+                data += written;
+                remaining -= written;
+                if (written > 0)
+                {
+                    dataCondition.notify_one();
+                }
+                if (remaining > 0)
+                {
+                    unique_lock<mutex> lock(waitMutex);
+                    spaceCondition.wait_for(lock, fullWait);
+                }
+            }
+
+            gst_buffer_unmap(buffer->gobj(), &map);
+            return flushing ? Gst::FLOW_FLUSHING : Gst::FLOW_OK;
+        }
+
+        // called from the streaming thread at EOS. the sink posts EOS once
+        // this returns, and the pipeline is reset then, which would
+        // drop what is still in the ring
+        void drain()
+        {
+            draining = true;
+            dataCondition.notify_one();
+
+            unique_lock<mutex> lock(waitMutex);
+            while (ring->size() > 0 && !flushing && !stopping)
+            {
+                spaceCondition.wait_for(lock, fullWait);
+            }
+            draining = false;
+        }
+
+        bool openDevice()
+        {
+            ao_initialize();
+
+            int driver = ao_default_driver_id();
+            if (const char* name = getenv("PLAYER_AO_DRIVER"))
+            {
+                driver = ao_driver_id(name);
+            }
+            if (driver < 0)
+            {
+                log(LT::error, "No libao driver to play through");
+                return false;
+            }
+            ao_info* info = ao_driver_info(driver);
+            paced = info && strcmp(info->short_name, "null") == 0;
+
+            ao_sample_format format = {};
+            format.bits = 16;
+            format.rate = rate;
+            format.channels = channels;
+            format.byte_format = AO_FMT_LITTLE;
+
+            if (const char* file = getenv("PLAYER_AO_FILE"))
+            {
+                device = ao_open_file(driver, file, 1, &format, nullptr);
+                toFile = true;
+            }
+            else
+            {
+                device = ao_open_live(driver, &format, nullptr);
+                toFile = false;
+            }
+
+            if (!device)
+            {
+                log(LT::error, "Could not open libao device, driver %d") % driver;
+                return false;
+            }
+            return true;
+        }
+    }
+
+    Glib::RefPtr<Gst::Element> createSink(size_t bufferMs)
+    {
+        auto sink = Gst::AppSink::create();
+        if (!sink)
+        {
+            return {};
+        }
+        if (!openDevice())
+        {
+            ao_shutdown();
+            return {};
+        }
+
+        if (const char* value = getenv("PLAYER_AO_BUFFER"))
+        {
+            bufferMs = max(atoi(value), 20);
+        }
+        ring = make_unique<SpscRing>(rate * bufferMs / 1000 * bytesPerFrame);
+        log(LT::info, "libao output, %u bytes of ring buffer") % ring->capacity();
+
+        sink->set_caps(Gst::Caps::create_from_string(
+                    "audio/x-raw,format=S16LE,layout=interleaved,rate=44100,channels=2"));
+        sink->set_property("sync", false);
+        sink->set_emit_signals(true);
+
+        // the handlers belong to the sink, so they must not hold a reference to it
+        Gst::AppSink* appSink = sink.operator->();
+        sink->signal_new_sample().connect([appSink]
+        {
+            return takeSample(appSink);
+        });
+
+        // a flushing seek must not wait for the device to make room,
+        // and what is in the ring belongs to before the seek.
+        // at EOS the ring is played out before the sink is done
+        sink->get_static_pad("sink")->add_probe(Gst::PAD_PROBE_TYPE_EVENT_DOWNSTREAM | Gst::PAD_PROBE_TYPE_EVENT_FLUSH,
+                [](const Glib::RefPtr<Gst::Pad>&, const Gst::PadProbeInfo& info)
+        {
+            auto type = info.get_event()->get_event_type();
+            if (type == Gst::EVENT_FLUSH_START)
+            {
+                beginFlush();
+            }
+            else if (type == Gst::EVENT_FLUSH_STOP)
+            {
+                endFlush();
+            }
+            else if (type == Gst::EVENT_EOS)
+            {
+                drain();
+            }
+            return Gst::PAD_PROBE_OK;
+        });
+
+        stopping = false;
+        outputThread = thread(outputThreadFunc);
+        return sink;
+    }
+
+    void end()
+    {
+        if (!outputThread.joinable())
+        {
+            return;
+        }
+
+        stopping = true;
+        dataCondition.notify_one();
+        spaceCondition.notify_one();
+        outputThread.join();
+
+        log(LT::info, "libao output: %u underruns") % underruns.load();
+
+        ao_close(device);
+        device = nullptr;
+        ring.reset();
+        ao_shutdown();
+    }
+
+    void setPlaying(bool play)
+    {
+        playing = play;
+        dataCondition.notify_one();
+    }
+
+    void beginFlush()
+    {
+        flushing = true;
+        spaceCondition.notify_one();
+    }
+
+    void endFlush()
+    {
+        // the streaming thread is stopped by now, so nothing is written in between
+        discardRequested = true;
+        dataCondition.notify_one();
+        while (discardRequested && outputThread.joinable() && !stopping)
+        {
+            this_thread::sleep_for(milliseconds(1));
+        }
+        flushing = false;
+    }
+
+    Stats stats()
+    {
+        Stats ret;
+        if (ring)
+        {
+            ret.fill = ring->size();
+            ret.capacity = ring->capacity();
+            ret.fillTime = static_cast<gint64>(ret.fill / bytesPerFrame) * Gst::SECOND / rate;
+        }
+        ret.underruns = underruns;
+        return ret;
+    }
+}
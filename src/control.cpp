@@ -0,0 +1,561 @@
+#include "control.hpp"
+#include "play.hpp"
+#include "playlist_io.hpp"
+#include "pcm_cache.hpp"
+#include "ao_output.hpp"
+#include "output.hpp"
+#include "play_stats.hpp"
+#include "log.hpp"
+
+#include <map>
+#include <set>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cctype>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <boost/format.hpp>
+
+using namespace std;
+using namespace playback;
+
+using boost::format;
+
+namespace control
+{
+    namespace
+    {
+        // a line longer than this is not a command, the client is dropped
+        const size_t maxLine = 64 * 1024;
+
+        struct Client
+        {
+            string in;
+            string out;
+            bool closing = false;
+        };
+
+        bool quitRequested = false;
+
+        // the signal handler only writes to this pipe, poll notices it
+        int signalPipe[2] = { -1, -1 };
+
+        void signalHandler(int)
+        {
+            char byte = 0;
+            if (write(signalPipe[1], &byte, 1) < 0)
+            {
+                // nothing can be done in a signal handler
+            }
+        }
+
+        void setNonBlocking(int fd)
+        {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+
+        string error(const string& reason)
+        {
+            return "error " + reason;
+        }
+
+        // digits only: strtoul would take "-1" and wrap it around
+        bool parseNumber(const string& text, unsigned long& value)
+        {
+            if (text.empty() || !isdigit(static_cast<unsigned char>(text[0])))
+            {
+                return false;
+            }
+            char* end = nullptr;
+            errno = 0;
+            value = strtoul(text.c_str(), &end, 10);
+            return *end == '\0' && errno != ERANGE;
+        }
+
+        bool parseMode(const string& word, set<PlaybackOption>& options)
+        {
+            istringstream stream(word);
+            string part;
+            bool first = true;
+            while (getline(stream, part, ','))
+            {
+                if (first)
+                {
+                    first = false;
+                    if (part == "now")            options.insert(PlaybackOption::stopCurrentPlayback);
+                    else if (part == "next")      options.insert(PlaybackOption::playAfterCurrentTrack);
+                    else if (part == "afterlist") options.insert(PlaybackOption::playAfterCurrentList);
+                    else if (part == "end")       options.insert(PlaybackOption::playAfterEverything);
+                    else if (part == "suspend")   options.insert(PlaybackOption::suspendCurrentPlayback);
+                    else return false;
+                }
+                else if (part == "shuffle")
+                {
+                    options.insert(PlaybackOption::shuffle);
+                }
+                else if (part == "spread")
+                {
+                    options.insert(PlaybackOption::spreadArtists);
+                }
+                else
+                {
+                    return false;
+                }
+            }
+            return !first;
+        }
+
+        string enqueue(const set<PlaybackOption>& options, const string& kind, const string& argument)
+        {
+            if (argument.empty())
+            {
+                return error("nothing to play");
+            }
+
+            if (kind == "track")
+            {
+                auto track = data::findTrack(argument);
+                if (!track)
+                {
+                    return error("no such track");
+                }
+                startPlayback(track, options);
+            }
+            else if (kind == "artist")
+            {
+                auto iter = data::artistsMap.find(argument);
+                if (iter == data::artistsMap.end())
+                {
+                    return error("no such artist");
+                }
+                startPlayback(iter->second, options);
+            }
+            else if (kind == "album")
+            {
+                // albums of allArtists hold the tracks of every artist
+                for (auto &album : data::allArtists->getAlbums())
+                {
+                    if (album->name == argument)
+                    {
+                        startPlayback(album, options);
+                        return "ok";
+                    }
+                }
+                return error("no such album");
+            }
+            else if (kind == "playlist")
+            {
+                auto playlist = playlistio::loadPlaylist(argument);
+                if (!playlist)
+                {
+                    return error("could not load playlist");
+                }
+                startPlayback(shared_ptr<Playlist>(playlist), options);
+            }
+            else
+            {
+                return error("unknown kind " + kind);
+            }
+            return "ok";
+        }
+
+        string status()
+        {
+            NowPlayingSnapshot snapshot = nowPlaying();
+
+            const char* state = "stopped";
+            if (snapshot.state == PlaybackState::playing)
+            {
+                state = "playing";
+            }
+            else if (snapshot.state == PlaybackState::paused)
+            {
+                state = "paused";
+            }
+
+            return (format("status %s %.3f %.3f %u %016x %s")
+                    % state
+                    % (snapshot.position / 1e9)
+                    % (snapshot.duration / 1e9)
+                    % snapshot.queueLength
+                    % snapshot.trackId
+                    % (snapshot.track ? snapshot.track->filepath : string())).str();
+        }
+
+        string execute(const string& line)
+        {
+            istringstream stream(line);
+            string name;
+            stream >> name;
+
+            if (name.empty())
+            {
+                return error("empty command");
+            }
+            else if (name == "status")
+            {
+                return status();
+            }
+            else if (name == "cache")
+            {
+                pcmcache::Stats stats = pcmcache::stats();
+                return (format("cache %u %u %u %u") % stats.hits % stats.misses % stats.tracks % stats.bytes).str();
+            }
+            else if (name == "output")
+            {
+                aooutput::Stats stats = aooutput::stats();
+                return (format("output %u %u %u") % stats.fill % stats.capacity % stats.underruns).str();
+            }
+            else if (name == "latency")
+            {
+                output::LatencyStats stats = output::latencyStats();
+                double hours = stats.played / 3600e9;
+                return (format("latency %s %.1f %u %.2f")
+                        % stats.profile % (stats.latency / 1e6) % stats.underruns
+                        % (hours > 0 ? stats.underruns / hours : 0.0)).str();
+            }
+            else if (name == "stats")
+            {
+                playstats::TrackStats stats;
+                if (!playstats::currentStats(stats))
+                {
+                    return "stats none";
+                }
+                auto ms = [](gint64 time) { return time < 0 ? -1.0 : time / 1e6; };
+                return (format("stats %016x %.1f %.1f %.1f %u %u %u %u %.1f")
+                        % stats.trackId % ms(stats.toPaused) % ms(stats.toPlaying) % ms(stats.firstBuffer)
+                        % stats.underruns % stats.qosMessages % stats.errors % stats.warnings
+                        % ms(stats.decoderCpu)).str();
+            }
+            else if (name == "pause" || name == "resume" || name == "toggle" || name == "stop" || name == "stopall")
+            {
+                static const map<string, CommandType> types =
+                {
+                    { "pause",   CommandType::pause },
+                    { "resume",  CommandType::resume },
+                    { "toggle",  CommandType::toggle },
+                    { "stop",    CommandType::stop },
+                    { "stopall", CommandType::stopAll },
+                };
+                sendPlaybackCommand(types.at(name));
+            }
+            else if (name == "next" || name == "previous")
+            {
+                Command command(name == "next" ? CommandType::next : CommandType::previous);
+                unsigned long count = 1;
+                string argument;
+                if (stream >> argument && (!parseNumber(argument, count) || count > UINT_MAX))
+                {
+                    return error("bad count");
+                }
+                if (count == 0)
+                {
+                    return "ok";
+                }
+                command.count = count;
+                sendPlaybackCommand(move(command));
+            }
+            else if (name == "seek")
+            {
+                string position;
+                string accurate;
+                stream >> position >> accurate;
+
+                char* end = nullptr;
+                double seconds = strtod(position.c_str(), &end);
+                // strtod also takes inf, nan and numbers that do not fit into nanoseconds
+                if (position.empty() || *end != '\0' || !isfinite(seconds) || fabs(seconds) > INT64_MAX / Gst::SECOND)
+                {
+                    return error("bad position");
+                }
+                bool relative = position[0] == '+' || position[0] == '-';
+                sendPlaybackCommand(Command::seek(static_cast<gint64>(seconds * Gst::SECOND), relative, accurate == "accurate"));
+            }
+            else if (name == "jump")
+            {
+                string argument;
+                unsigned long index;
+                if (!(stream >> argument) || !parseNumber(argument, index))
+                {
+                    return error("bad index");
+                }
+                sendPlaybackCommand(Command::jump(index));
+            }
+            else if (name == "play" || name == "enqueue")
+            {
+                set<PlaybackOption> options;
+                if (name == "play")
+                {
+                    options.insert(PlaybackOption::stopCurrentPlayback);
+                }
+                else
+                {
+                    string mode;
+                    stream >> mode;
+                    if (!parseMode(mode, options))
+                    {
+                        return error("bad mode");
+                    }
+                }
+
+                string kind;
+                stream >> kind;
+
+                // the argument is the rest of the line, it can have spaces in it
+                string argument;
+                getline(stream >> ws, argument);
+                return enqueue(options, kind, argument);
+            }
+            else if (name == "quit")
+            {
+                quitRequested = true;
+            }
+            else
+            {
+                return error("unknown command " + name);
+            }
+            return "ok";
+        }
+
+        // returns false if the client has gone away
+        bool readFrom(int fd, Client& client)
+        {
+            char buffer[4096];
+            while (true)
+            {
+                ssize_t count = read(fd, buffer, sizeof(buffer));
+                if (count == 0)
+                {
+                    return false;
+                }
+                if (count < 0)
+                {
+                    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+                }
+                client.in.append(buffer, count);
+
+                // everything that has arrived is answered in one go
+                size_t start = 0;
+                size_t newline;
+                while ((newline = client.in.find('\n', start)) != string::npos)
+                {
+                    string line = client.in.substr(start, newline - start);
+                    if (!line.empty() && line.back() == '\r')
+                    {
+                        line.pop_back();
+                    }
+                    client.out += execute(line);
+                    client.out += '\n';
+                    start = newline + 1;
+                }
+                client.in.erase(0, start);
+
+                if (client.in.size() > maxLine)
+                {
+                    client.out += error("line too long") + "\n";
+                    client.closing = true;
+                    return true;
+                }
+            }
+        }
+
+        // returns false if the client has gone away
+        bool writeTo(int fd, Client& client)
+        {
+            while (!client.out.empty())
+            {
+                ssize_t count = send(fd, client.out.data(), client.out.size(), MSG_NOSIGNAL);
+                if (count < 0)
+                {
+                    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+                }
+                client.out.erase(0, count);
+            }
+            return !client.closing;
+        }
+    }
+
+    string defaultSocketPath()
+    {
+        if (const char* runtimeDir = getenv("XDG_RUNTIME_DIR"))
+        {
+            return string(runtimeDir) + "/player.sock";
+        }
+        return (format("/tmp/player-%u.sock") % getuid()).str();
+    }
+
+    bool run(const string& socketPath)
+    {
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if (socketPath.size() >= sizeof(address.sun_path))
+        {
+            log(LT::error, "Socket path is too long: %s") % socketPath;
+            return false;
+        }
+        strcpy(address.sun_path, socketPath.c_str());
+
+        int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener < 0)
+        {
+            log(LT::error, "Could not create socket: %s") % strerror(errno);
+            return false;
+        }
+        setNonBlocking(listener);
+
+        // a socket left over from a previous run would make bind fail.
+        // only a socket that nobody answers on is removed: anything else
+        // was given by mistake or belongs to a player that is still running
+        struct stat info;
+        if (lstat(socketPath.c_str(), &info) == 0)
+        {
+            if (!S_ISSOCK(info.st_mode))
+            {
+                log(LT::error, "%s exists and is not a socket") % socketPath;
+                close(listener);
+                return false;
+            }
+
+            int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+            bool answered = probe >= 0 && connect(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+            if (probe >= 0)
+            {
+                close(probe);
+            }
+            if (answered)
+            {
+                log(LT::error, "Another player is listening on %s") % socketPath;
+                close(listener);
+                return false;
+            }
+            unlink(socketPath.c_str());
+        }
+
+        // created for the owner only, nobody else can connect in between
+        mode_t mask = umask(077);
+        bool bound = bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+        umask(mask);
+        if (!bound || listen(listener, 64) != 0)
+        {
+            log(LT::error, "Could not listen on %s: %s") % socketPath % strerror(errno);
+            close(listener);
+            return false;
+        }
+
+        if (pipe(signalPipe) != 0)
+        {
+            log(LT::error, "Could not create signal pipe: %s") % strerror(errno);
+            close(listener);
+            unlink(socketPath.c_str());
+            return false;
+        }
+        setNonBlocking(signalPipe[0]);
+        setNonBlocking(signalPipe[1]);
+        signal(SIGINT, signalHandler);
+        signal(SIGTERM, signalHandler);
+        signal(SIGPIPE, SIG_IGN);
+
+        log(LT::info, "Listening on %s") % socketPath;
+
+        map<int, Client> clients;
+        vector<pollfd> fds;
+        quitRequested = false;
+
+        while (!quitRequested)
+        {
+            fds.clear();
+            fds.push_back({ listener, POLLIN, 0 });
+            fds.push_back({ signalPipe[0], POLLIN, 0 });
+            for (auto &client : clients)
+            {
+                short events = POLLIN;
+                if (!client.second.out.empty())
+                {
+                    events |= POLLOUT;
+                }
+                fds.push_back({ client.first, events, 0 });
+            }
+
+            if (poll(fds.data(), fds.size(), -1) < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                log(LT::error, "poll failed: %s") % strerror(errno);
+                break;
+            }
+
+            if (fds[1].revents & POLLIN)
+            {
+                break;
+            }
+
+            for (size_t i = 2; i < fds.size(); i++)
+            {
+                if (!fds[i].revents)
+                {
+                    continue;
+                }
+
+                int fd = fds[i].fd;
+                Client& client = clients[fd];
+                bool alive = true;
+                if (fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+                {
+                    alive = readFrom(fd, client);
+                }
+                if (alive)
+                {
+                    alive = writeTo(fd, client);
+                }
+
+                if (!alive)
+                {
+                    close(fd);
+                    clients.erase(fd);
+                }
+            }
+
+            if (fds[0].revents & POLLIN)
+            {
+                int fd;
+                while ((fd = accept(listener, nullptr, nullptr)) >= 0)
+                {
+                    setNonBlocking(fd);
+                    clients[fd];
+                }
+            }
+        }
+
+        // the reply to quit should still get out
+        for (auto &client : clients)
+        {
+            writeTo(client.first, client.second);
+            close(client.first);
+        }
+
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        close(signalPipe[0]);
+        close(signalPipe[1]);
+        close(listener);
+        unlink(socketPath.c_str());
+        return true;
+    }
+}
@@ -1,5 +1,10 @@
 #include "data.hpp"
 #include "log.hpp"
+#include "hash.hpp"
+#include "output.hpp"
+#include "mapped_source.hpp"
+#include "pcm_cache.hpp"
+#include "loudness.hpp"
 
 #include <algorithm>
 #include <exception>
@@ -7,6 +12,11 @@
 #include <string>
 #include <iostream>
 #include <regex>
+#include <vector>
+#include <sstream>
+
+#include <unistd.h>
+#include <limits.h>
 
 #include <boost/format.hpp>
 
@@ -23,6 +33,8 @@ namespace data
     shared_ptr<Artist> allArtists;
     shared_ptr<Artist> unknownArtist;
 
+    unordered_map<string, shared_ptr<Track>> tracksByPath;
+
     void init()
     {
         allArtists    = make_shared<Artist>("all");
@@ -33,6 +45,7 @@ namespace data
     {
         artistsMap.clear();
         artists.clear();
+        tracksByPath.clear();
 
         allArtists.reset();
         unknownArtist.reset();
@@ -40,6 +53,7 @@ namespace data
 
     void addTrack(shared_ptr<Track> track)
     {
+        tracksByPath.emplace(normalizePath(track->filepath), track);
         allArtists->addTrack(track);
 
         if (track->artistName.empty())
@@ -79,25 +93,100 @@ namespace data
         return ret;
     }
 
+    shared_ptr<Track> findTrack(const string& path)
+    {
+        auto iter = tracksByPath.find(normalizePath(path));
+        if (iter == tracksByPath.end())
+        {
+            return nullptr;
+        }
+        return iter->second;
+    }
+
+    string normalizePath(const string& path)
+    {
+        string full = path;
+        if (full.empty() || full.front() != '/')
+        {
+            char cwd[PATH_MAX];
+            if (getcwd(cwd, sizeof(cwd)) != nullptr)
+            {
+                full = string(cwd) + "/" + full;
+            }
+        }
+
+        vector<string> components;
+        istringstream stream(full);
+        string component;
+        while (getline(stream, component, '/'))
+        {
+            if (component.empty() || component == ".")
+            {
+                continue;
+            }
+            if (component == "..")
+            {
+                if (!components.empty())
+                {
+                    components.pop_back();
+                }
+                continue;
+            }
+            components.push_back(move(component));
+        }
+
+        string ret;
+        for (auto &c : components)
+        {
+            ret += "/";
+            ret += c;
+        }
+        return ret.empty() ? "/" : ret;
+    }
+
 
 
     OpenedTrack::OpenedTrack() {}
 
-    OpenedTrack::OpenedTrack(const Track* parent) :
+    OpenedTrack::OpenedTrack(const Track* parent, Source source) :
         parent(parent),
-        filepath(parent->filepath)
+        filepath(parent->filepath),
+        eos(make_shared<atomic<bool>>(false))
     {
         assert(parent != nullptr);
 
-        pipeline = Gst::Pipeline::create();
+        bin = Gst::Bin::create();
 
-        src = Gst::FileSrc::create();
+        // the cached beginning of the track, if the rest has to come from the file
+        Glib::RefPtr<Gst::Element> head;
+        if (source == Source::any)
+        {
+            src = pcmcache::createSource(parent->id, cachedUntil);
+            if (cachedUntil != Gst::CLOCK_TIME_NONE)
+            {
+                head = src;
+                src.reset();
+            }
+            cached = static_cast<bool>(src);
+        }
+        if (!src && source != Source::tags && mappedsource::enabled() && mappedsource::suitable(filepath))
+        {
+            src = mappedsource::create(filepath);
+        }
+        if (!src)
+        {
+            auto fileSrc = Gst::FileSrc::create();
+            if (fileSrc)
+            {
+                fileSrc->property_location() = filepath;
+                src = fileSrc;
+            }
+        }
         if (!src)
         {
             log("Error creating source: %s") % filepath;
             return;
         }
-        src->property_location() = filepath;
 
         decode = Gst::ElementFactory::create_element("decodebin");
         if (!decode)
@@ -106,38 +195,140 @@ namespace data
             return;
         }
 
-        conv = Gst::ElementFactory::create_element("audioconvert");
-        if (!conv)
+        bin->add(src)->add(decode);
+        src->link(decode);
+
+        Glib::RefPtr<Gst::Element> join;
+        Glib::RefPtr<Gst::Pad> filePad;
+        if (head)
         {
-            log("Error creating audioconvert: %s") % filepath;
-            return;
+            join = Gst::ElementFactory::create_element("concat");
+            if (join)
+            {
+                bin->add(head)->add(join);
+                head->link(join);
+                filePad = join->get_request_pad("sink_%u");
+            }
+            if (!filePad)
+            {
+                log("Error creating concat, not using the cached beginning of %s") % filepath;
+                join.reset();
+                cachedUntil = Gst::CLOCK_TIME_NONE;
+            }
         }
 
-        resample = Gst::ElementFactory::create_element("audioresample");
-        if (!resample)
+        // tracks that are mixed together have to agree on the format,
+        // so with crossfade each one converts its own output.
+        // the gain is per track too, and volume does not take every format
+        Glib::RefPtr<Gst::Pad> convertPad;
+        if (output::crossfadeEnabled() || loudness::enabled())
         {
-            log("Error creating audioresample: %s") % filepath;
-            return;
+            auto convert  = Gst::ElementFactory::create_element("audioconvert");
+            auto resample = Gst::ElementFactory::create_element("audioresample");
+            if (!convert || !resample)
+            {
+                log("Error creating converters: %s") % filepath;
+                return;
+            }
+            bin->add(convert)->add(resample);
+            convert->link(resample);
+            convertPad = convert->get_static_pad("sink");
+
+            Glib::RefPtr<Gst::Element> last = resample;
+            if (loudness::enabled())
+            {
+                volume = Gst::ElementFactory::create_element("volume");
+                if (!volume)
+                {
+                    log("Error creating volume: %s") % filepath;
+                    return;
+                }
+                volume->set_property("volume", loudness::gain(*parent));
+                bin->add(volume);
+                resample->link(volume);
+                last = volume;
+            }
+
+            pad = Gst::GhostPad::create(last->get_static_pad("src"), "src");
         }
-
-        sink = Gst::ElementFactory::create_element("autoaudiosink");
-        if (!sink)
+        else
         {
-            log("Error creating autoaudiosink: %s") % filepath;
-            return;
+            // the target is set once decodebin knows what it is decoding
+            pad = Gst::GhostPad::create(Gst::PAD_SRC, "src");
         }
+        bin->add_pad(pad);
 
-        pipeline->add(src)->add(decode)->add(conv)->add(resample)->add(sink);
-        src->link(decode);
-        conv->link(resample);
-        resample->link(sink);
+        // OpenedTrack is moved around while prerolling,
+        // so the handlers must not capture this
+        auto ghost = pad;
+        if (join)
+        {
+            // the cached beginning and then the file both come out of concat
+            auto joined = join->get_static_pad("src");
+            if (convertPad)
+            {
+                joined->link(convertPad);
+            }
+            else
+            {
+                ghost->set_target(joined);
+            }
+        }
 
-        decode->signal_pad_added().connect([this](const Glib::RefPtr<Gst::Pad>& pad)
+        auto skip = cachedUntil;
+        decode->signal_pad_added().connect([ghost, convertPad, filePad, skip](const Glib::RefPtr<Gst::Pad>& decodedPad)
         {
-            decode->link(conv);
+            auto caps = decodedPad->get_current_caps();
+            if (caps && caps->to_string().compare(0, 5, "audio") != 0)
+            {
+                return;
+            }
+
+            if (filePad)
+            {
+                if (filePad->is_linked())
+                {
+                    return;
+                }
+                // what is cached is dropped, the rest is moved back to follow it
+                decodedPad->add_probe(Gst::PAD_PROBE_TYPE_BUFFER,
+                        [skip](const Glib::RefPtr<Gst::Pad>&, const Gst::PadProbeInfo& info)
+                {
+                    auto buffer = info.get_buffer();
+                    auto pts = buffer->get_pts();
+                    if (pts != Gst::CLOCK_TIME_NONE && pts + buffer->get_duration() <= skip)
+                    {
+                        return Gst::PAD_PROBE_DROP;
+                    }
+                    return Gst::PAD_PROBE_OK;
+                });
+                decodedPad->set_offset(-static_cast<gint64>(skip));
+                decodedPad->link(filePad);
+            }
+            else if (convertPad)
+            {
+                if (!convertPad->is_linked())
+                {
+                    decodedPad->link(convertPad);
+                }
+            }
+            else if (!ghost->get_target())
+            {
+                ghost->set_target(decodedPad);
+            }
         });
 
-        pipeline->set_state(Gst::STATE_PAUSED);
+        auto eosFlag = eos;
+        pad->add_probe(Gst::PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+                [eosFlag](const Glib::RefPtr<Gst::Pad>&, const Gst::PadProbeInfo& info)
+        {
+            if (info.get_event()->get_event_type() == Gst::EVENT_EOS)
+            {
+                *eosFlag = true;
+                output::notify();
+            }
+            return Gst::PAD_PROBE_OK;
+        });
 
         valid = true;
     }
@@ -146,16 +337,34 @@ namespace data
         parent(other.parent),
         filepath(other.filepath)
     {
-        pipeline = move(other.pipeline);
+        bin       = move(other.bin);
+        src       = move(other.src);
+        decode    = move(other.decode);
+        pad       = move(other.pad);
+        volume    = move(other.volume);
+        outputPad = move(other.outputPad);
+        eos       = move(other.eos);
+        cached = other.cached;
+        cachedUntil = other.cachedUntil;
         valid = other.valid;
         other.valid = false;
     }
 
     void OpenedTrack::operator= (OpenedTrack&& other)
     {
+        markAsInvalid();
+
         parent = other.parent;
         filepath = other.filepath;
-        pipeline = move(other.pipeline);
+        bin       = move(other.bin);
+        src       = move(other.src);
+        decode    = move(other.decode);
+        pad       = move(other.pad);
+        volume    = move(other.volume);
+        outputPad = move(other.outputPad);
+        eos       = move(other.eos);
+        cached = other.cached;
+        cachedUntil = other.cachedUntil;
         valid = other.valid;
         other.valid = false;
     }
@@ -164,7 +373,14 @@ namespace data
     {
         if (valid)
         {
-            pipeline->set_state(Gst::STATE_NULL);
+            if (outputPad)
+            {
+                output::detach(*this);
+            }
+            else
+            {
+                bin->set_state(Gst::STATE_NULL);
+            }
         }
         valid = false;
     }
@@ -174,12 +390,14 @@ namespace data
         return valid;
     }
 
+    bool OpenedTrack::finished() const
+    {
+        return valid && *eos;
+    }
+
     OpenedTrack::~OpenedTrack()
     {
-        if (valid)
-        {
-            pipeline->set_state(Gst::STATE_NULL);
-        }
+        markAsInvalid();
     }
 
 
@@ -187,18 +405,26 @@ namespace data
     Track::Track(const string& file)
     {
         filepath = file;
+        id = Fnv1a::hash(normalizePath(filepath));
 
-        auto opened = open();
+        OpenedTrack opened(this, OpenedTrack::Source::tags);
         if (!opened.isValid())
         {
             log("Cannot read track data from %s") % filepath;
             exit(1); //TODO: proper error handling
         }
 
+        // tags are posted by the sink, so the track needs one to preroll into
+        auto pipeline = Gst::Pipeline::create();
+        auto sink = Gst::ElementFactory::create_element("fakesink");
+        pipeline->add(opened.bin)->add(sink);
+        opened.pad->link(sink->get_static_pad("sink"));
+        pipeline->set_state(Gst::STATE_PAUSED);
 
         Gst::TagList list;
-        Glib::RefPtr<Gst::MessageTag> message = Glib::RefPtr<Gst::MessageTag>::cast_static(opened.pipeline->get_bus()->poll(Gst::MESSAGE_TAG, Gst::CLOCK_TIME_NONE));
+        Glib::RefPtr<Gst::MessageTag> message = Glib::RefPtr<Gst::MessageTag>::cast_static(pipeline->get_bus()->poll(Gst::MESSAGE_TAG, Gst::CLOCK_TIME_NONE));
         message->parse(list);
+        pipeline->set_state(Gst::STATE_NULL);
 
         Glib::ustring str;
         bool readSuccess;
@@ -225,9 +451,17 @@ namespace data
         }
     }
 
-    OpenedTrack Track::open() const
+    Track::Track(const string& file, const string& name, const string& artistName, const string& albumName) :
+        filepath(file),
+        id(Fnv1a::hash(normalizePath(file))),
+        name(name),
+        artistName(artistName),
+        albumName(albumName)
+    {}
+
+    OpenedTrack Track::open(OpenedTrack::Source source) const
     {
-        return OpenedTrack(this);
+        return OpenedTrack(this, source);
     }
 
     void Track::testPrint() const
@@ -0,0 +1,287 @@
+#include "duplicates.hpp"
+#include "library_index.hpp"
+#include "workers.hpp"
+#include "hash.hpp"
+#include "io_throttle.hpp"
+#include "log.hpp"
+
+#include <unordered_map>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+
+using namespace std;
+using namespace chrono;
+
+using data::Track;
+
+namespace duplicates
+{
+    size_t ioBudget    = 16 * 1024 * 1024;
+    size_t workerCount = 2;
+
+    namespace
+    {
+        const size_t readChunk = 64 * 1024;
+
+        unique_ptr<WorkerPool> pool;
+        atomic<bool>           stopping{ false };
+
+        mutex                                          hashesMutex;
+        unordered_map<const Track*, uint64_t>          hashes;
+        unordered_map<uint64_t, vector<const Track*>>  copies;
+
+        // shared by all workers
+        IoThrottle throttle;
+
+        uint32_t readLE32(const unsigned char* bytes)
+        {
+            return (static_cast<uint32_t>(bytes[3]) << 24) | (bytes[2] << 16) | (bytes[1] << 8) | bytes[0];
+        }
+
+        /*
+           Finds where the audio starts and ends, skipping
+           ID3v2 and FLAC metadata blocks at the beginning
+           and ID3v1 and APEv2 tags at the end.
+           Containers that interleave tags with audio (ogg, mp4) are hashed whole
+           */
+        void findPayload(FILE* file, int64_t size, int64_t& begin, int64_t& end)
+        {
+            begin = 0;
+            end = size;
+
+            unsigned char header[10];
+            while (fseek(file, begin, SEEK_SET) == 0 && fread(header, 1, 10, file) == 10 && memcmp(header, "ID3", 3) == 0)
+            {
+                // syncsafe integer, 7 bits per byte
+                int64_t tagSize = (header[6] & 0x7f) << 21 | (header[7] & 0x7f) << 14 | (header[8] & 0x7f) << 7 | (header[9] & 0x7f);
+                begin += 10 + tagSize + ((header[5] & 0x10) ? 10 : 0);
+            }
+
+            if (fseek(file, begin, SEEK_SET) == 0 && fread(header, 1, 4, file) == 4 && memcmp(header, "fLaC", 4) == 0)
+            {
+                begin += 4;
+                bool last = false;
+                while (!last && fseek(file, begin, SEEK_SET) == 0 && fread(header, 1, 4, file) == 4)
+                {
+                    last = header[0] & 0x80;
+                    begin += 4 + ((header[1] << 16) | (header[2] << 8) | header[3]);
+                }
+            }
+
+            unsigned char footer[32];
+            if (end - 128 >= begin && fseek(file, end - 128, SEEK_SET) == 0 && fread(footer, 1, 3, file) == 3 && memcmp(footer, "TAG", 3) == 0)
+            {
+                end -= 128;
+            }
+
+            if (end - 32 >= begin && fseek(file, end - 32, SEEK_SET) == 0 && fread(footer, 1, 32, file) == 32 && memcmp(footer, "APETAGEX", 8) == 0)
+            {
+                // size includes the footer but not the header
+                int64_t tagSize = readLE32(footer + 12);
+                bool hasHeader = readLE32(footer + 20) & 0x80000000u;
+                end -= tagSize + (hasHeader ? 32 : 0);
+            }
+
+            begin = min(max<int64_t>(begin, 0), size);
+            end = max(min(end, size), begin);
+        }
+
+        bool hashPayload(const string& path, int64_t size, uint64_t& hash)
+        {
+            FILE* file = fopen(path.c_str(), "rb");
+            if (!file)
+            {
+                return false;
+            }
+
+            int64_t begin;
+            int64_t end;
+            findPayload(file, size, begin, end);
+            fseek(file, begin, SEEK_SET);
+
+            Fnv1a hasher;
+            vector<char> buffer(readChunk);
+            int64_t remaining = end - begin;
+            while (remaining > 0 && !stopping)
+            {
+                size_t toRead = min<int64_t>(remaining, readChunk);
+                throttle.take(toRead, ioBudget);
+
+                size_t read = fread(buffer.data(), 1, toRead, file);
+                if (read == 0)
+                {
+                    break;
+                }
+                hasher.update(buffer.data(), read);
+                remaining -= read;
+            }
+            fclose(file);
+
+            if (remaining > 0)
+            {
+                return false;
+            }
+
+            uint64_t payloadSize = end - begin;
+            hasher.update(&payloadSize, sizeof(payloadSize));
+            hash = hasher.digest();
+            return true;
+        }
+
+        void addHash(const Track* track, uint64_t hash)
+        {
+            lock_guard<mutex> lock(hashesMutex);
+            hashes[track] = hash;
+            copies[hash].push_back(track);
+        }
+
+        void hashTrack(shared_ptr<Track> track)
+        {
+            if (stopping)
+            {
+                return;
+            }
+
+            libindex::Entry entry;
+            if (libindex::lookup(track->filepath, entry) && entry.hasContentHash)
+            {
+                addHash(track.get(), entry.contentHash);
+                return;
+            }
+
+            if (!libindex::stat(track->filepath, entry))
+            {
+                return;
+            }
+
+            uint64_t hash;
+            if (hashPayload(track->filepath, entry.size, hash))
+            {
+                // the loudness analysis writes to the same entries
+                libindex::update(track->filepath, [hash](libindex::Entry& stored)
+                {
+                    stored.hasContentHash = true;
+                    stored.contentHash = hash;
+                });
+                addHash(track.get(), hash);
+            }
+        }
+    }
+
+    void start()
+    {
+        stopping = false;
+        pool = make_unique<WorkerPool>(workerCount);
+
+        // cached hashes are cheap, but they still stat every file
+        for (auto &track : data::allArtists->getTracks())
+        {
+            pool->submit([track] { hashTrack(track); });
+        }
+    }
+
+    void end()
+    {
+        stopping = true;
+        pool.reset();
+
+        lock_guard<mutex> lock(hashesMutex);
+        hashes.clear();
+        copies.clear();
+    }
+
+    bool contentHash(const shared_ptr<Track>& track, uint64_t& hash)
+    {
+        lock_guard<mutex> lock(hashesMutex);
+        auto iter = hashes.find(track.get());
+        if (iter == hashes.end())
+        {
+            return false;
+        }
+        hash = iter->second;
+        return true;
+    }
+
+    bool isDuplicate(const shared_ptr<Track>& track)
+    {
+        lock_guard<mutex> lock(hashesMutex);
+        auto hash = hashes.find(track.get());
+        if (hash == hashes.end())
+        {
+            return false;
+        }
+
+        auto& group = copies[hash->second];
+        auto shown = min_element(group.begin(), group.end(), [](const Track* fst, const Track* snd)
+        {
+            return fst->filepath < snd->filepath;
+        });
+        return *shown != track.get();
+    }
+
+    size_t copyCount(const shared_ptr<Track>& track)
+    {
+        lock_guard<mutex> lock(hashesMutex);
+        auto hash = hashes.find(track.get());
+        if (hash == hashes.end())
+        {
+            return 0;
+        }
+        return copies[hash->second].size();
+    }
+
+    list<shared_ptr<Track>> collapse(const list<shared_ptr<Track>>& tracks)
+    {
+        list<shared_ptr<Track>> ret;
+        for (auto &track : tracks)
+        {
+            if (!isDuplicate(track))
+            {
+                ret.push_back(track);
+            }
+        }
+        return ret;
+    }
+
+    size_t hashedCount()
+    {
+        lock_guard<mutex> lock(hashesMutex);
+        return hashes.size();
+    }
+}
+
+
+
+DuplicatesPlaylist::DuplicatesPlaylist(const string& name) : Playlist(name) {}
+
+list<shared_ptr<Track>> DuplicatesPlaylist::getTracks() const
+{
+    list<shared_ptr<Track>> ret;
+
+    for (auto &track : data::allArtists->getTracks())
+    {
+        if (duplicates::copyCount(track) > 1)
+        {
+            ret.push_back(track);
+        }
+    }
+
+    return ret;
+}
+
+void DuplicatesPlaylist::testPrint() const
+{
+    cout << "starting to print playlist " << name << endl;
+    for (auto &track : getTracks())
+    {
+        track->testPrint();
+    }
+    cout << "done printing playlist " << name << endl;
+}
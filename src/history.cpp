@@ -0,0 +1,254 @@
+#include "history.hpp"
+#include "log.hpp"
+
+#include <unordered_map>
+#include <vector>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace chrono;
+
+namespace history
+{
+    float playedThreshold = 0.5;
+
+    const char* historyPath = "player.history";
+
+    namespace
+    {
+        const char     historyMagic[4] = { 'P', 'L', 'H', 'S' };
+        const uint32_t historyVersion  = 1;
+
+        struct Header
+        {
+            char     magic[4];
+            uint32_t version;
+            uint64_t count;
+        };
+
+        struct Record
+        {
+            uint64_t trackId;
+            int64_t  timestamp;
+            float    fraction;
+            uint32_t reserved;
+        };
+
+        int      fd = -1;
+        char*    mapping = nullptr;
+        size_t   mappingSize = 0;
+
+        Header* header()
+        {
+            return reinterpret_cast<Header*>(mapping);
+        }
+
+        Record* records()
+        {
+            return reinterpret_cast<Record*>(mapping + sizeof(Header));
+        }
+
+        size_t capacity()
+        {
+            return (mappingSize - sizeof(Header)) / sizeof(Record);
+        }
+
+        shared_timed_mutex                 statsMutex;
+        unordered_map<uint64_t, Stats>     statsIndex;
+
+        mutex                   pendingMutex;
+        condition_variable      pendingCondition;
+        vector<Record>          pending;
+        bool                    stopping = false;
+        thread                  writerThread;
+
+        void index(const Record& record)
+        {
+            // a skip after a few seconds is not a play, it stays in the log but counts for nothing
+            if (record.fraction < playedThreshold)
+            {
+                return;
+            }
+            auto& stats = statsIndex[record.trackId];
+            stats.playCount++;
+            stats.lastPlayed = max<time_t>(stats.lastPlayed, record.timestamp);
+        }
+
+        bool resize(size_t newSize)
+        {
+            if (ftruncate(fd, newSize) != 0)
+            {
+                return false;
+            }
+
+            void* newMapping = mapping
+                ? mremap(mapping, mappingSize, newSize, MREMAP_MAYMOVE)
+                : mmap(nullptr, newSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (newMapping == MAP_FAILED)
+            {
+                return false;
+            }
+
+            mapping = static_cast<char*>(newMapping);
+            mappingSize = newSize;
+            return true;
+        }
+
+        void append(const Record& record)
+        {
+            if (header()->count == capacity())
+            {
+                if (!resize(sizeof(Header) + capacity() * 2 * sizeof(Record)))
+                {
+                    log(LT::error, "Could not grow history log");
+                    return;
+                }
+            }
+
+            // the record is written before the count, so a crash
+            // can lose the last entry but never leaves a broken one
+            records()[header()->count] = record;
+            header()->count++;
+
+            unique_lock<shared_timed_mutex> lock(statsMutex);
+            index(record);
+        }
+
+        void writerFunc()
+        {
+            vector<Record> batch;
+            while (true)
+            {
+                {
+                    unique_lock<mutex> lock(pendingMutex);
+                    pendingCondition.wait(lock, [] { return stopping || !pending.empty(); });
+                    if (pending.empty())
+                    {
+                        return;
+                    }
+                    batch.swap(pending);
+                }
+
+                for (auto &record : batch)
+                {
+                    append(record);
+                }
+                batch.clear();
+            }
+        }
+    }
+
+    void init()
+    {
+        fd = open(historyPath, O_RDWR | O_CREAT, 0644);
+        if (fd < 0)
+        {
+            log(LT::error, "Could not open history log %s") % historyPath;
+            return;
+        }
+
+        struct stat st;
+        fstat(fd, &st);
+
+        bool fresh = static_cast<size_t>(st.st_size) < sizeof(Header);
+        size_t size = fresh ? sizeof(Header) + 1024 * sizeof(Record) : st.st_size;
+        if (!resize(size))
+        {
+            log(LT::error, "Could not map history log %s") % historyPath;
+            close(fd);
+            fd = -1;
+            return;
+        }
+
+        if (fresh)
+        {
+            memcpy(header()->magic, historyMagic, 4);
+            header()->version = historyVersion;
+            header()->count = 0;
+        }
+        else if (memcmp(header()->magic, historyMagic, 4) != 0 || header()->version != historyVersion || header()->count > capacity())
+        {
+            log(LT::error, "History log %s is corrupted, history is disabled") % historyPath;
+            munmap(mapping, mappingSize);
+            mapping = nullptr;
+            close(fd);
+            fd = -1;
+            return;
+        }
+
+        {
+            unique_lock<shared_timed_mutex> lock(statsMutex);
+            for (uint64_t i = 0; i < header()->count; i++)
+            {
+                index(records()[i]);
+            }
+        }
+        log(LT::info, "Loaded %d history entries") % header()->count;
+
+        stopping = false;
+        writerThread = thread(writerFunc);
+    }
+
+    void end()
+    {
+        if (fd < 0)
+        {
+            return;
+        }
+
+        {
+            lock_guard<mutex> lock(pendingMutex);
+            stopping = true;
+        }
+        pendingCondition.notify_one();
+        writerThread.join();
+
+        munmap(mapping, mappingSize);
+        mapping = nullptr;
+        close(fd);
+        fd = -1;
+
+        unique_lock<shared_timed_mutex> lock(statsMutex);
+        statsIndex.clear();
+    }
+
+    void record(const shared_ptr<data::Track>& track, float fractionPlayed)
+    {
+        if (fd < 0 || !track)
+        {
+            return;
+        }
+
+        Record record{};
+        record.trackId = track->id;
+        record.timestamp = system_clock::to_time_t(system_clock::now());
+        record.fraction = fractionPlayed;
+
+        {
+            lock_guard<mutex> lock(pendingMutex);
+            pending.push_back(record);
+        }
+        pendingCondition.notify_one();
+    }
+
+    Stats stats(uint64_t trackId)
+    {
+        shared_lock<shared_timed_mutex> lock(statsMutex);
+        auto iter = statsIndex.find(trackId);
+        if (iter == statsIndex.end())
+        {
+            return {};
+        }
+        return iter->second;
+    }
+}
@@ -1,5 +1,6 @@
 #include "interface.hpp"
 #include "play.hpp"
+#include "duplicates.hpp"
 #include "log.hpp"
 
 #include "ncurses_wrapper.hpp"
@@ -35,6 +36,29 @@ bool interface::DataLists::albumsUpdated = true;
 bool interface::DataLists::tracksUpdated = true;
 
 bool doShuffle = false;
+bool doSpreadArtists = false;
+bool doCollapse = false;
+bool doAccurateSeek = false;
+
+// how far the arrows in the playback window seek
+const gint64 seekStep = 5 * Gst::SECOND;
+
+// contents of the tracks window before duplicates are collapsed
+list<shared_ptr<Track>> tracksSource;
+
+void setTracksList(list<shared_ptr<Track>> tracks)
+{
+    tracksSource = move(tracks);
+    if (doCollapse)
+    {
+        DataLists::tracksList = duplicates::collapse(tracksSource);
+    }
+    else
+    {
+        DataLists::tracksList = tracksSource;
+    }
+    DataLists::tracksUpdated = true;
+}
 
 void initInterface()
 {
@@ -239,24 +263,36 @@ bool readKey()
             fullRefresh();
             break;
         case ' ':
-            // TODO: override operator new to return static value.
-            sendPlaybackCommand(new CommandTOGGLE());
+            sendPlaybackCommand(CommandType::toggle);
             break;
         case 'e': // (E)nd
-            sendPlaybackCommand(new CommandSTOP());
+            sendPlaybackCommand(CommandType::stop);
             break;
         case 'E':
-            sendPlaybackCommand(new CommandSTOPALL());
+            sendPlaybackCommand(CommandType::stopAll);
             break;
         case '<':
-            sendPlaybackCommand(new CommandPREVIOUS());
+            sendPlaybackCommand(CommandType::previous);
             break;
         case '>':
-            sendPlaybackCommand(new CommandNEXT());
+            sendPlaybackCommand(CommandType::next);
             break;
         case 't': //(t)oggle shuffle
             doShuffle = !doShuffle;
             break;
+        case 'T':
+            doSpreadArtists = !doSpreadArtists;
+            break;
+        case 'c': //(c)ollapse duplicates
+            doCollapse = !doCollapse;
+            setTracksList(move(tracksSource));
+            break;
+        case 'u': //d(u)plicates
+            setTracksList(DuplicatesPlaylist().getTracks());
+            break;
+        case 'a': //(a)ccurate seeking
+            doAccurateSeek = !doAccurateSeek;
+            break;
         default:
             {
                 if (auto locked = mainWindow->getSelected().lock())
@@ -815,8 +851,7 @@ void AlbumsListingWindow::select()
         return;
     }
 
-    DataLists::tracksList = (*cursorPos)->getTracks();
-    DataLists::tracksUpdated = true;
+    setTracksList((*cursorPos)->getTracks());
 }
 
 void AlbumsListingWindow::press(int key)
@@ -831,6 +866,10 @@ void AlbumsListingWindow::press(int key)
     {
         options.insert(PlaybackOption::shuffle);
     }
+    if (doSpreadArtists)
+    {
+        options.insert(PlaybackOption::spreadArtists);
+    }
 
     bool play = true;
     switch (key)
@@ -869,9 +908,8 @@ void ArtistsListingWindow::select()
     }
 
     DataLists::albumsList = (*cursorPos)->getAlbums();
-    DataLists::tracksList = DataLists::albumsList.front()->getTracks();
     DataLists::albumsUpdated = true;
-    DataLists::tracksUpdated = true;
+    setTracksList(DataLists::albumsList.front()->getTracks());
 }
 
 void ArtistsListingWindow::press(int key)
@@ -886,6 +924,10 @@ void ArtistsListingWindow::press(int key)
     {
         options.insert(PlaybackOption::shuffle);
     }
+    if (doSpreadArtists)
+    {
+        options.insert(PlaybackOption::spreadArtists);
+    }
 
     bool play = true;
     switch (key)
@@ -955,12 +997,12 @@ void PlaybackControlWindow::afterReshape()
 
 void PlaybackControlWindow::rewindForward()
 {
-
+    sendPlaybackCommand(Command::seek(seekStep, true, doAccurateSeek));
 }
 
 void PlaybackControlWindow::rewindBackward()
 {
-
+    sendPlaybackCommand(Command::seek(-seekStep, true, doAccurateSeek));
 }
 
 void PlaybackControlWindow::playbackWindowThread()
@@ -970,30 +1012,30 @@ void PlaybackControlWindow::playbackWindowThread()
         clear();
         resetCursor();
 
-        if (playbackInProcess() && play::NowPlaying::track)
+        play::NowPlayingSnapshot snapshot = play::nowPlaying();
+        if (snapshot.state != play::PlaybackState::stopped && snapshot.track)
         {
-            if (playbackInProcess())
             {
                 wattron(nwindow, A_BOLD);
                 print("Track: ");
                 wattroff(nwindow, A_BOLD);
-                printfmt("%s", play::NowPlaying::track->name);
+                printfmt("%s", snapshot.track->name);
                 nextLine();
 
                 wattron(nwindow, A_BOLD);
                 print("Album: ");
                 wattroff(nwindow, A_BOLD);
-                printfmt("%s", play::NowPlaying::track->albumName);
+                printfmt("%s", snapshot.track->albumName);
                 nextLine();
 
                 wattron(nwindow, A_BOLD);
                 print("Artist: ");
                 wattroff(nwindow, A_BOLD);
-                printfmt("%s", play::NowPlaying::track->artistName);
+                printfmt("%s", snapshot.track->artistName);
                 nextLine();
 
                 wattron(nwindow, A_BOLD);
-                if (play::playbackPause)
+                if (snapshot.state == play::PlaybackState::paused)
                 {
                     //wprintw(nwindow, "Paused:  ");
                     print("Paused:  ");
@@ -1010,8 +1052,8 @@ void PlaybackControlWindow::playbackWindowThread()
                 char* duration = new char[10];
                 char* current = new char[10];
 
-                snprintf(duration, 10, "%" GST_TIME_FORMAT, GST_TIME_ARGS(play::NowPlaying::duration));
-                snprintf(current, 10, "%" GST_TIME_FORMAT, GST_TIME_ARGS(play::NowPlaying::current));
+                snprintf(duration, 10, "%" GST_TIME_FORMAT, GST_TIME_ARGS(snapshot.duration));
+                snprintf(current, 10, "%" GST_TIME_FORMAT, GST_TIME_ARGS(snapshot.position));
                 replace(duration, duration+10, '.', '\0');
                 replace(current, current+10, '.', '\0');
                 //wprintw(nwindow, "%s / %s", current, duration);
@@ -1022,6 +1064,22 @@ void PlaybackControlWindow::playbackWindowThread()
                 delete [] current;
             }
 
+            if (snapshot.queueLength > 0)
+            {
+                printfmt("%u more in the queue", snapshot.queueLength);
+                nextLine();
+            }
+
+            auto queue = play::queue();
+            if (snapshot.queueIndex + 1 < queue->tracks.size())
+            {
+                wattron(nwindow, A_BOLD);
+                print("Next: ");
+                wattroff(nwindow, A_BOLD);
+                printfmt("%s", queue->tracks[snapshot.queueIndex + 1]->name);
+                nextLine();
+            }
+
         }
 
         if (doShuffle)
@@ -1035,6 +1093,39 @@ void PlaybackControlWindow::playbackWindowThread()
             print({nlines-1, ncols-1}, "S");
         }
 
+        if (doCollapse)
+        {
+            wattron(nwindow, A_REVERSE);
+            print({nlines-1, ncols-2}, "C");
+            wattroff(nwindow, A_REVERSE);
+        }
+        else
+        {
+            print({nlines-1, ncols-2}, "C");
+        }
+
+        if (doSpreadArtists)
+        {
+            wattron(nwindow, A_REVERSE);
+            print({nlines-1, ncols-4}, "T");
+            wattroff(nwindow, A_REVERSE);
+        }
+        else
+        {
+            print({nlines-1, ncols-4}, "T");
+        }
+
+        if (doAccurateSeek)
+        {
+            wattron(nwindow, A_REVERSE);
+            print({nlines-1, ncols-3}, "A");
+            wattroff(nwindow, A_REVERSE);
+        }
+        else
+        {
+            print({nlines-1, ncols-3}, "A");
+        }
+
         Window::update();
 
         this_thread::sleep_for(100ms);
@@ -0,0 +1,166 @@
+#include "library_index.hpp"
+#include "log.hpp"
+
+#include <unordered_map>
+#include <mutex>
+#include <fstream>
+#include <sstream>
+
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace libindex
+{
+    const char* indexPath   = "player.index";
+    const char* indexHeader = "player-index 2";
+    // without loudness, still read
+    const char* indexHeaderV1 = "player-index 1";
+
+    namespace
+    {
+        mutex                         indexMutex;
+        unordered_map<string, Entry>  entries;
+        bool                          modified = false;
+    }
+
+    void load()
+    {
+        ifstream in(indexPath);
+        if (!in)
+        {
+            return;
+        }
+
+        string line;
+        bool v1 = false;
+        if (getline(in, line) && line == indexHeaderV1)
+        {
+            v1 = true;
+        }
+        else if (line != indexHeader)
+        {
+            log(LT::warning, "Ignoring library index with unknown format");
+            return;
+        }
+
+        lock_guard<mutex> lock(indexMutex);
+        while (getline(in, line))
+        {
+            // path is the last field, so it can contain anything but a newline
+            istringstream fields(line);
+            Entry entry;
+            int hasContentHash;
+            fields >> entry.size >> entry.mtime >> hasContentHash >> hex >> entry.contentHash >> dec;
+            entry.hasContentHash = hasContentHash != 0;
+            if (!v1)
+            {
+                int hasLoudness;
+                fields >> hasLoudness >> entry.loudness >> entry.peak >> entry.loudnessBlocks;
+                entry.hasLoudness = hasLoudness != 0;
+            }
+
+            string path;
+            if (!fields || fields.get() != '\t' || !getline(fields, path))
+            {
+                continue;
+            }
+
+            entries[path] = entry;
+        }
+
+        log(LT::info, "Loaded library index: %d entries") % entries.size();
+    }
+
+    void save()
+    {
+        lock_guard<mutex> lock(indexMutex);
+        if (!modified)
+        {
+            return;
+        }
+
+        ofstream out(indexPath);
+        if (!out)
+        {
+            log(LT::error, "Could not write library index %s") % indexPath;
+            return;
+        }
+
+        out << indexHeader << '\n';
+        for (auto &entry : entries)
+        {
+            out << entry.second.size << ' '
+                << entry.second.mtime << ' '
+                << entry.second.hasContentHash << ' '
+                << hex << entry.second.contentHash << dec << ' '
+                << entry.second.hasLoudness << ' '
+                << entry.second.loudness << ' '
+                << entry.second.peak << ' '
+                << entry.second.loudnessBlocks << '\t'
+                << entry.first << '\n';
+        }
+
+        modified = false;
+    }
+
+    bool stat(const string& path, Entry& entry)
+    {
+        struct stat st;
+        if (::stat(path.c_str(), &st) != 0)
+        {
+            return false;
+        }
+
+        entry.size  = st.st_size;
+        entry.mtime = st.st_mtime;
+        return true;
+    }
+
+    bool lookup(const string& path, Entry& entry)
+    {
+        Entry current;
+        if (!stat(path, current))
+        {
+            return false;
+        }
+
+        lock_guard<mutex> lock(indexMutex);
+        auto iter = entries.find(path);
+        if (iter == entries.end() || iter->second.size != current.size || iter->second.mtime != current.mtime)
+        {
+            return false;
+        }
+
+        entry = iter->second;
+        return true;
+    }
+
+    void store(const string& path, const Entry& entry)
+    {
+        lock_guard<mutex> lock(indexMutex);
+        entries[path] = entry;
+        modified = true;
+    }
+
+    bool update(const string& path, const function<void(Entry&)>& change)
+    {
+        Entry current;
+        if (!stat(path, current))
+        {
+            return false;
+        }
+
+        lock_guard<mutex> lock(indexMutex);
+        auto iter = entries.find(path);
+        if (iter == entries.end() || iter->second.size != current.size || iter->second.mtime != current.mtime)
+        {
+            entries[path] = current;
+            iter = entries.find(path);
+        }
+
+        change(iter->second);
+        modified = true;
+        return true;
+    }
+}
@@ -24,6 +24,12 @@ string ltToString(LogType type)
 
 ofstream fout("player.log");
 
+mutex& logMutex()
+{
+    static mutex ret;
+    return ret;
+}
+
 Log log(const string& formatString)
 {
     return Log(fout, formatString, true);
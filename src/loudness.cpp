@@ -0,0 +1,366 @@
+#include "loudness.hpp"
+#include "library_index.hpp"
+#include "workers.hpp"
+#include "r128.hpp"
+#include "log.hpp"
+
+#include <unordered_map>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+using namespace std;
+using namespace chrono;
+
+using data::Track;
+
+namespace loudness
+{
+    GainMode mode              = GainMode::track;
+    double   referenceLoudness = -18.0;
+    size_t   workerCount       = 0;
+
+    namespace
+    {
+        // nice value of analysis threads, on top of SCHED_IDLE where there is one
+        const int idleNice = 19;
+
+        unique_ptr<WorkerPool> pool;
+        atomic<bool>           stopping{ false };
+
+        // tracks of an album, keyed by artist and album name
+        struct Album
+        {
+            size_t   trackCount = 0;
+            size_t   measuredCount = 0;
+            // energy of every measured track times its blocks, see R128Meter
+            double   energy = 0;
+            uint64_t blocks = 0;
+            double   peak = 0;
+        };
+
+        mutex                                        measurementsMutex;
+        unordered_map<const Track*, Measurement>     measurements;
+        map<pair<string, string>, Album>             albums;
+
+        pair<string, string> albumKey(const Track& track)
+        {
+            return { track.artistName, track.albumName };
+        }
+
+        // the calling thread only, on Linux both calls work per thread.
+        // without privileges it can not be undone
+        void lowerPriority()
+        {
+#ifdef SCHED_IDLE
+            sched_param idle = {};
+            sched_setscheduler(0, SCHED_IDLE, &idle);
+#endif
+            setpriority(PRIO_PROCESS, syscall(SYS_gettid), idleNice);
+        }
+
+        void addMeasurement(const Track* track, const Measurement& result)
+        {
+            lock_guard<mutex> lock(measurementsMutex);
+            if (!measurements.emplace(track, result).second)
+            {
+                return;
+            }
+
+            Album& album = albums[albumKey(*track)];
+            album.measuredCount++;
+            album.energy += R128Meter::toEnergy(result.loudness) * result.blocks;
+            album.blocks += result.blocks;
+            album.peak = max(album.peak, result.peak);
+        }
+
+        // a track that can not be measured would keep its album from being complete
+        void dropFromAlbum(const Track* track)
+        {
+            lock_guard<mutex> lock(measurementsMutex);
+            auto album = albums.find(albumKey(*track));
+            if (album != albums.end() && album->second.trackCount > 0)
+            {
+                album->second.trackCount--;
+            }
+        }
+
+        // decodes the whole file, returns false if it could not be or analysis was stopped
+        bool analyze(const string& path, Measurement& result)
+        {
+            auto pipeline = Gst::Pipeline::create();
+            auto src      = Gst::FileSrc::create();
+            auto decode   = Gst::ElementFactory::create_element("decodebin");
+            auto convert  = Gst::ElementFactory::create_element("audioconvert");
+            auto sink     = Gst::AppSink::create();
+            if (!pipeline || !src || !decode || !convert || !sink)
+            {
+                log(LT::error, "Could not create loudness analysis pipeline for %s") % path;
+                return false;
+            }
+
+            src->property_location() = path;
+            sink->set_caps(Gst::Caps::create_from_string("audio/x-raw,format=F32LE,layout=interleaved"));
+            sink->set_property("sync", false);
+            // the streaming threads come from a pool that playback uses too,
+            // so their priority can not be lowered for good. instead they
+            // stop after every buffer until the idle worker has taken it,
+            // and decode only as fast as the worker is allowed to run
+            sink->set_property("max-buffers", 1u);
+            sink->set_property("drop", false);
+
+            pipeline->add(src)->add(decode)->add(convert)->add(sink);
+            src->link(decode);
+            convert->link(sink);
+
+            auto convertPad = convert->get_static_pad("sink");
+            decode->signal_pad_added().connect([convertPad](const Glib::RefPtr<Gst::Pad>& decodedPad)
+            {
+                auto caps = decodedPad->get_current_caps();
+                if ((!caps || caps->to_string().compare(0, 5, "audio") == 0) && !convertPad->is_linked())
+                {
+                    decodedPad->link(convertPad);
+                }
+            });
+
+            pipeline->set_state(Gst::STATE_PLAYING);
+
+            unique_ptr<R128Meter> meter;
+            unsigned channels = 0;
+            bool ok = true;
+            while (true)
+            {
+                if (stopping)
+                {
+                    ok = false;
+                    break;
+                }
+
+                if (pipeline->get_bus()->pop(Gst::MESSAGE_ERROR))
+                {
+                    log(LT::warning, "Could not decode %s for loudness analysis") % path;
+                    ok = false;
+                    break;
+                }
+
+                auto sample = sink->try_pull_sample(100 * Gst::MILLI_SECOND);
+                if (!sample)
+                {
+                    if (sink->is_eos())
+                    {
+                        break;
+                    }
+                    continue;
+                }
+
+                if (!meter)
+                {
+                    int rate = 0;
+                    int channelCount = 0;
+                    auto caps = sample->get_caps();
+                    if (!caps || !caps->get_structure(0).get_field("rate", rate)
+                            || !caps->get_structure(0).get_field("channels", channelCount)
+                            || rate <= 0 || channelCount <= 0)
+                    {
+                        ok = false;
+                        break;
+                    }
+                    channels = channelCount;
+                    meter = make_unique<R128Meter>(rate, channels);
+                }
+
+                auto buffer = sample->get_buffer();
+                GstMapInfo map;
+                if (buffer && gst_buffer_map(buffer->gobj(), &map, GST_MAP_READ))
+                {
+                    meter->add(reinterpret_cast<const float*>(map.data), map.size / sizeof(float) / channels);
+                    gst_buffer_unmap(buffer->gobj(), &map);
+                }
+            }
+
+            pipeline->set_state(Gst::STATE_NULL);
+
+            if (!ok || !meter)
+            {
+                return false;
+            }
+
+            // silence is left alone
+            result.blocks = meter->gatedBlocks();
+            result.loudness = result.blocks ? meter->integrated() : referenceLoudness;
+            result.peak = meter->peak();
+            return true;
+        }
+
+        void measureTrack(shared_ptr<Track> track)
+        {
+            if (stopping)
+            {
+                return;
+            }
+
+            // worker threads belong to the pool and never play anything
+            thread_local bool lowered = false;
+            if (!lowered)
+            {
+                lowerPriority();
+                lowered = true;
+            }
+
+            libindex::Entry entry;
+            if (libindex::lookup(track->filepath, entry) && entry.hasLoudness)
+            {
+                addMeasurement(track.get(), { entry.loudness, entry.peak, entry.loudnessBlocks });
+                return;
+            }
+
+            auto started = steady_clock::now();
+            Measurement result;
+            if (!analyze(track->filepath, result))
+            {
+                if (!stopping)
+                {
+                    log(LT::warning, "Could not measure %s, its album is measured without it") % track->filepath;
+                    dropFromAlbum(track.get());
+                }
+                return;
+            }
+            log(LT::debug, "Measured %s: %.2f LUFS, peak %.3f, in %d ms")
+                % track->filepath % result.loudness % result.peak
+                % duration_cast<milliseconds>(steady_clock::now() - started).count();
+
+            libindex::update(track->filepath, [&result](libindex::Entry& stored)
+            {
+                stored.hasLoudness = true;
+                stored.loudness = result.loudness;
+                stored.peak = result.peak;
+                stored.loudnessBlocks = result.blocks;
+            });
+            addMeasurement(track.get(), result);
+        }
+
+        // the largest value of volume's "volume" property
+        const double maxGain = 10.0;
+
+        double toGain(double loudness, double peak)
+        {
+            double gain = pow(10.0, (referenceLoudness - loudness) / 20.0);
+            if (peak > 0)
+            {
+                gain = min(gain, 1.0 / peak);
+            }
+            // the volume element takes nothing louder, a quiet track
+            // with no known peak would be refused
+            return min(gain, maxGain);
+        }
+    }
+
+    void start()
+    {
+        if (const char* value = getenv("PLAYER_REPLAYGAIN"))
+        {
+            if (strcmp(value, "off") == 0)
+            {
+                mode = GainMode::off;
+            }
+            else if (strcmp(value, "album") == 0)
+            {
+                mode = GainMode::album;
+            }
+            else
+            {
+                mode = GainMode::track;
+            }
+        }
+
+        if (!enabled())
+        {
+            return;
+        }
+
+        stopping = false;
+        auto tracks = data::allArtists->getTracks();
+        {
+            lock_guard<mutex> lock(measurementsMutex);
+            for (auto &track : tracks)
+            {
+                albums[albumKey(*track)].trackCount++;
+            }
+        }
+
+        pool = make_unique<WorkerPool>(workerCount);
+        for (auto &track : tracks)
+        {
+            pool->submit([track] { measureTrack(track); });
+        }
+    }
+
+    void end()
+    {
+        stopping = true;
+        pool.reset();
+
+        lock_guard<mutex> lock(measurementsMutex);
+        measurements.clear();
+        albums.clear();
+    }
+
+    bool enabled()
+    {
+        return mode != GainMode::off;
+    }
+
+    bool measurement(const Track& track, Measurement& result)
+    {
+        lock_guard<mutex> lock(measurementsMutex);
+        auto iter = measurements.find(&track);
+        if (iter == measurements.end())
+        {
+            return false;
+        }
+        result = iter->second;
+        return true;
+    }
+
+    double gain(const Track& track)
+    {
+        if (!enabled())
+        {
+            return 1.0;
+        }
+
+        lock_guard<mutex> lock(measurementsMutex);
+        auto iter = measurements.find(&track);
+        if (iter == measurements.end() || iter->second.blocks == 0)
+        {
+            return 1.0;
+        }
+
+        // until the whole album is measured its loudness would keep changing
+        if (mode == GainMode::album && !track.albumName.empty())
+        {
+            auto album = albums.find(albumKey(track));
+            if (album != albums.end() && album->second.measuredCount == album->second.trackCount && album->second.blocks > 0)
+            {
+                return toGain(R128Meter::toLoudness(album->second.energy / album->second.blocks), album->second.peak);
+            }
+        }
+        return toGain(iter->second.loudness, iter->second.peak);
+    }
+
+    size_t measuredCount()
+    {
+        lock_guard<mutex> lock(measurementsMutex);
+        return measurements.size();
+    }
+}
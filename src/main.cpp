@@ -2,6 +2,14 @@
 #include "play.hpp"
 #include "interface.hpp"
 #include "playlist.hpp"
+#include "library_index.hpp"
+#include "duplicates.hpp"
+#include "history.hpp"
+#include "prefetch.hpp"
+#include "render.hpp"
+#include "loudness.hpp"
+#include "pcm_cache.hpp"
+#include "control.hpp"
 
 #include "log.hpp"
 
@@ -32,17 +40,104 @@ int main(int argc, char** argv)
     Gst::init(argc, argv);
 
     data::init();
+    libindex::load();
+
+    bool daemon = false;
+    string socketPath = control::defaultSocketPath();
+
+    bool renderMode = false;
+    render::Options renderOptions;
 
     for (int i = 1; i < argc; i++)
     {
-        data::addTrack(make_shared<data::Track>(argv[i]));
+        string arg = argv[i];
+        // an option that takes a value is not a file name when it comes last
+        if ((arg == "--socket" || arg == "--render" || arg == "--out" || arg == "--format" || arg == "--jobs")
+                && i + 1 == argc)
+        {
+            cerr << arg << " needs a value" << endl;
+            return 1;
+        }
+
+        if (arg == "--daemon")
+        {
+            daemon = true;
+        }
+        else if (arg == "--socket")
+        {
+            socketPath = argv[++i];
+        }
+        else if (arg == "--render")
+        {
+            renderMode = true;
+            renderOptions.query = argv[++i];
+        }
+        else if (arg == "--out")
+        {
+            renderOptions.outDir = argv[++i];
+        }
+        else if (arg == "--format")
+        {
+            renderOptions.format = argv[++i];
+        }
+        else if (arg == "--jobs")
+        {
+            renderOptions.jobs = max(atoi(argv[++i]), 0);
+        }
+        else
+        {
+            data::addTrack(make_shared<data::Track>(argv[i]));
+        }
+    }
+
+    if (const char* threads = getenv("PLAYER_CONDITION_THREADS"))
+    {
+        SmartPlaylist::setThreadCount(max(atoi(threads), 0));
+    }
+
+    if (renderMode)
+    {
+        if (renderOptions.outDir.empty())
+        {
+            cerr << "--render needs --out" << endl;
+            return 1;
+        }
+
+        // files are written as they are, devices do their own gain
+        loudness::mode = loudness::GainMode::off;
+        int ret = render::run(renderOptions) ? 0 : 1;
+
+        libindex::save();
+        data::end();
+        return ret;
     }
 
+    duplicates::start();
+    loudness::start();
+    history::init();
+    prefetch::start();
+    pcmcache::init();
     playback::init();
 
-    interfaceLoop();
+    int ret = 0;
+    if (daemon)
+    {
+        ret = control::run(socketPath) ? 0 : 1;
+    }
+    else
+    {
+        interfaceLoop();
+    }
     
     playback::end();
+    pcmcache::end();
+    prefetch::end();
+    history::end();
+    loudness::end();
+    duplicates::end();
 
+    libindex::save();
     data::end();
+
+    return ret;
 }
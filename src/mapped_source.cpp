@@ -0,0 +1,270 @@
+#include "mapped_source.hpp"
+#include "log.hpp"
+
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+
+using namespace std;
+
+namespace mappedsource
+{
+    namespace
+    {
+        // decoders ask for small reads, there is no reason
+        // to hand out the mapping in pieces that small
+        const size_t minBufferSize = 256 * 1024;
+
+        // from linux/magic.h and the filesystems that do not export theirs
+        const long networkFilesystems[] =
+        {
+            0x6969,      // nfs
+            0x517b,      // smb
+            0xff534d42,  // cifs
+            0xfe534d42,  // smb2
+            0x65735546,  // fuse
+            0x73757245,  // coda
+            0x5346414f,  // afs
+            0x00c36400,  // ceph
+            0x01021997,  // 9p
+            0x47504653,  // gpfs
+            0x013111a8,  // ibrix
+            0x0bd00bd0,  // lustre
+        };
+
+        // mappings the SIGBUS handler may patch up, a slot is free when its start is null.
+        // the handler can not take locks, so this is a fixed array of atomics
+        const size_t maxMappings = 64;
+        atomic<char*>  mappedStart[maxMappings];
+        atomic<size_t> mappedSize[maxMappings];
+
+        // registering takes it, the handler only reads
+        mutex            mappingsMutex;
+        struct sigaction previousAction;
+        uintptr_t        pageSize = 4096;
+
+        // a file that shrinks under its mapping raises SIGBUS on the pages past its end.
+        // those pages are replaced with zeroes, the decoder sees garbage instead
+        // of killing the process, and need-data notices the new size and ends the stream
+        void busHandler(int signal, siginfo_t* info, void* context)
+        {
+            char* address = static_cast<char*>(info->si_addr);
+            for (size_t i = 0; i < maxMappings; i++)
+            {
+                char* start = mappedStart[i];
+                if (start && address >= start && address < start + mappedSize[i])
+                {
+                    void* pageStart = reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(address) & ~(pageSize - 1));
+                    if (mmap(pageStart, pageSize, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != MAP_FAILED)
+                    {
+                        return;
+                    }
+                }
+            }
+
+            // not ours, whatever was there before decides
+            if (previousAction.sa_flags & SA_SIGINFO)
+            {
+                previousAction.sa_sigaction(signal, info, context);
+            }
+            else if (previousAction.sa_handler != SIG_IGN && previousAction.sa_handler != SIG_DFL)
+            {
+                previousAction.sa_handler(signal);
+            }
+            else
+            {
+                // the fault happens again when this returns and ends the process as usual
+                sigaction(SIGBUS, &previousAction, nullptr);
+            }
+        }
+
+        // mappingsMutex has to be held
+        void installHandler()
+        {
+            static bool installed = false;
+            if (installed)
+            {
+                return;
+            }
+            installed = true;
+            pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+
+            struct sigaction action;
+            memset(&action, 0, sizeof(action));
+            action.sa_sigaction = busHandler;
+            action.sa_flags = SA_SIGINFO;
+            sigemptyset(&action.sa_mask);
+            sigaction(SIGBUS, &action, &previousAction);
+        }
+
+        struct Mapping
+        {
+            void*  data = MAP_FAILED;
+            size_t size = 0;
+            // kept open to see if the file is truncated while it plays
+            int    fd = -1;
+            // in mappedStart, maxMappings if it could not be registered
+            size_t slot = maxMappings;
+            // read position, appsrc calls need-data and seek-data from its streaming thread
+            atomic<size_t> offset{ 0 };
+
+            // false if there is no free slot, then the file must not be mapped
+            bool registerMapping()
+            {
+                lock_guard<mutex> lock(mappingsMutex);
+                installHandler();
+                for (size_t i = 0; i < maxMappings; i++)
+                {
+                    if (!mappedStart[i])
+                    {
+                        // the size first, the handler only looks at slots with a start
+                        mappedSize[i] = size;
+                        mappedStart[i] = static_cast<char*>(data);
+                        slot = i;
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            // how much of the mapping is still backed by the file
+            size_t available()
+            {
+                struct stat info;
+                if (fstat(fd, &info) != 0)
+                {
+                    return 0;
+                }
+                return min<size_t>(info.st_size, size);
+            }
+
+            ~Mapping()
+            {
+                if (slot < maxMappings)
+                {
+                    lock_guard<mutex> lock(mappingsMutex);
+                    mappedStart[slot] = nullptr;
+                }
+                if (data != MAP_FAILED)
+                {
+                    munmap(data, size);
+                }
+                if (fd >= 0)
+                {
+                    close(fd);
+                }
+            }
+        };
+
+        void releaseMapping(gpointer mapping)
+        {
+            delete static_cast<shared_ptr<Mapping>*>(mapping);
+        }
+    }
+
+    bool enabled()
+    {
+        const char* value = getenv("PLAYER_MMAP");
+        return !value || strcmp(value, "0") != 0;
+    }
+
+    bool suitable(const string& path)
+    {
+        struct statfs info;
+        if (statfs(path.c_str(), &info) != 0)
+        {
+            return false;
+        }
+
+        long type = static_cast<long>(info.f_type) & 0xffffffffL;
+        return find(begin(networkFilesystems), end(networkFilesystems), type) == end(networkFilesystems);
+    }
+
+    Glib::RefPtr<Gst::Element> create(const string& path)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return {};
+        }
+
+        auto mapping = make_shared<Mapping>();
+        mapping->fd = fd;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0)
+        {
+            mapping->size = info.st_size;
+            mapping->data = mmap(nullptr, mapping->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+
+        if (mapping->data == MAP_FAILED)
+        {
+            log(LT::warning, "Could not map %s, reading it instead") % path;
+            return {};
+        }
+        if (!mapping->registerMapping())
+        {
+            log(LT::debug, "Too many files mapped, reading %s instead") % path;
+            return {};
+        }
+        madvise(mapping->data, mapping->size, MADV_SEQUENTIAL);
+
+        auto src = Gst::AppSrc::create();
+        if (!src)
+        {
+            return {};
+        }
+        src->set_stream_type(Gst::APP_STREAM_TYPE_RANDOM_ACCESS);
+        src->set_size(mapping->size);
+
+        // the handlers belong to the source, so they must not hold a reference to it
+        Gst::AppSrc* source = src.operator->();
+
+        src->signal_need_data().connect([source, mapping, path](guint length)
+        {
+            // one fstat per buffer, the pages past a new end would read as zeroes
+            size_t offset = mapping->offset;
+            size_t available = mapping->available();
+            if (offset >= available)
+            {
+                if (available < mapping->size)
+                {
+                    log(LT::warning, "%s was truncated while playing") % path;
+                }
+                source->end_of_stream();
+                return;
+            }
+
+            size_t size = min(max<size_t>(length, minBufferSize), available - offset);
+            mapping->offset = offset + size;
+
+            // every buffer holds a reference to the mapping
+            GstBuffer* buffer = gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY,
+                    mapping->data, mapping->size, offset, size,
+                    new shared_ptr<Mapping>(mapping), releaseMapping);
+            source->push_buffer(Glib::wrap(buffer, false));
+        });
+
+        src->signal_seek_data().connect([mapping](guint64 offset)
+        {
+            if (offset > mapping->size)
+            {
+                return false;
+            }
+            mapping->offset = offset;
+            return true;
+        });
+
+        return src;
+    }
+}
@@ -0,0 +1,636 @@
+#include "output.hpp"
+#include "ao_output.hpp"
+#include "play_stats.hpp"
+#include "log.hpp"
+
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <list>
+
+using namespace std;
+using namespace chrono;
+
+namespace output
+{
+    string audioSink = "autoaudiosink";
+    gint64 crossfade = 0;
+
+    namespace
+    {
+        const LatencyProfile latencyProfiles[] =
+        {
+            { "low-latency", 40000,   10000, 20 * Gst::MILLI_SECOND },
+            { "balanced",    200000,  10000, 200 * Gst::MILLI_SECOND },
+            { "robust",      1000000, 40000, 2 * Gst::SECOND },
+        };
+    }
+
+    const LatencyProfile* latencyProfile = &latencyProfiles[1];
+
+    Glib::RefPtr<Gst::Pipeline> pipeline;
+
+    function<void()> onEvent;
+
+    namespace
+    {
+        // concat, or audiomixer with crossfade
+        Glib::RefPtr<Gst::Element> input;
+        Glib::RefPtr<Gst::Element> conv;
+        Glib::RefPtr<Gst::Element> resample;
+        Glib::RefPtr<Gst::Queue>   queue;
+        Glib::RefPtr<Gst::Element> sink;
+
+        // buffer-time of the element that talks to the device, microseconds
+        atomic<gint64>  sinkBufferTime{ 0 };
+
+        // the queue also runs dry when streaming starts or after a flush,
+        // that only counts once buffers went through it
+        atomic<bool>     flowing{ false };
+        atomic<bool>     playing{ false };
+        atomic<uint64_t> queueUnderruns{ 0 };
+        // EOS went into the queue, it running dry after that is the end of playback
+        atomic<bool>     ending{ false };
+        // when play() was called, and the time played before that
+        atomic<int64_t>  playStart{ 0 };
+        atomic<int64_t>  playedBefore{ 0 };
+
+        // input pads in the order the tracks were attached
+        list<Glib::RefPtr<Gst::Pad>> inputPads;
+        size_t attachedEver = 0;
+
+        // bins of the attached tracks, only compared with message sources.
+        // an error inside one that is not current only takes that track down
+        list<GstObject*> attachedBins;
+        list<GstObject*> failedBins;
+
+        atomic<bool>    switchPending{ false };
+        atomic<int64_t> switchStart{ 0 };
+        atomic<int64_t> switchStartCpu{ 0 };
+        atomic<const char*> switchName{ "" };
+        // set by the sink's streaming thread when the switch is heard, -1 until then.
+        // logging writes a file, so it is left to the playback thread
+        atomic<int64_t> switchTook{ -1 };
+        atomic<int64_t> switchTookCpu{ 0 };
+        atomic<const char*> switchTookName{ "" };
+        uint64_t        loggedUnderruns = 0;
+
+        int64_t nowNs()
+        {
+            return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+        }
+
+        // how long the output has been playing since the last reset or seek
+        gint64 runningTime()
+        {
+            // after a reset the clock is left over from the last run
+            Gst::State state, pending;
+            pipeline->get_state(state, pending, 0);
+            auto clock = pipeline->get_clock();
+            if (state != Gst::STATE_PLAYING || !clock)
+            {
+                return 0;
+            }
+            return static_cast<gint64>(clock->get_time() - pipeline->get_base_time());
+        }
+
+        // the attached track the message came from, nullptr for the output's own elements
+        GstObject* sourceBin(const Glib::RefPtr<Gst::Message>& message)
+        {
+            GstObject* source = message->get_source()->gobj();
+            for (GstObject* bin : attachedBins)
+            {
+                if (source == bin || gst_object_has_as_ancestor(source, bin))
+                {
+                    return bin;
+                }
+            }
+            return nullptr;
+        }
+
+        int64_t cpuNs()
+        {
+            timespec ts;
+            clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+            return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+        }
+
+        bool hasProperty(const Glib::RefPtr<Gst::Element>& element, const char* name)
+        {
+            return g_object_class_find_property(G_OBJECT_GET_CLASS(element->gobj()), name);
+        }
+
+        // applies the profile to an audio sink, anything without the
+        // properties of GstAudioBaseSink is left alone
+        void configureSink(const Glib::RefPtr<Gst::Element>& element)
+        {
+            if (!hasProperty(element, "buffer-time") || !hasProperty(element, "latency-time"))
+            {
+                return;
+            }
+
+            element->set_property("buffer-time", latencyProfile->bufferTime);
+            element->set_property("latency-time", latencyProfile->latencyTime);
+            sinkBufferTime = latencyProfile->bufferTime;
+            log(LT::debug, "%s buffers %.0f ms in %.0f ms segments")
+                % element->get_name() % (latencyProfile->bufferTime / 1e3) % (latencyProfile->latencyTime / 1e3);
+        }
+
+        void stopPlayTime()
+        {
+            if (int64_t start = playStart.exchange(0))
+            {
+                playedBefore += nowNs() - start;
+            }
+        }
+
+        Glib::RefPtr<Gst::Element> createElement(const string& name)
+        {
+            auto element = Gst::ElementFactory::create_element(name);
+            if (!element)
+            {
+                log(LT::error, "Error creating %s") % name;
+            }
+            return element;
+        }
+    }
+
+    bool init()
+    {
+        if (const char* sinkName = getenv("PLAYER_AUDIO_SINK"))
+        {
+            audioSink = sinkName;
+        }
+        if (const char* seconds = getenv("PLAYER_CROSSFADE"))
+        {
+            crossfade = static_cast<gint64>(max(atof(seconds), 0.0) * Gst::SECOND);
+        }
+        if (const char* name = getenv("PLAYER_LATENCY"))
+        {
+            auto profile = find_if(std::begin(latencyProfiles), std::end(latencyProfiles), [&](const LatencyProfile& profile)
+            {
+                return string(name) == profile.name;
+            });
+            if (profile != std::end(latencyProfiles))
+            {
+                latencyProfile = profile;
+            }
+            else
+            {
+                log(LT::warning, "Unknown latency profile %s, using %s") % name % latencyProfile->name;
+            }
+        }
+
+        pipeline = Gst::Pipeline::create("output");
+
+        input    = createElement(crossfadeEnabled() ? "audiomixer" : "concat");
+        conv     = createElement("audioconvert");
+        resample = createElement("audioresample");
+        queue    = Gst::Queue::create();
+        sink     = audioSink == "ao"
+            ? aooutput::createSink(latencyProfile->bufferTime / 1000)
+            : createElement(audioSink);
+        if (!input || !conv || !resample || !queue || !sink)
+        {
+            pipeline.reset();
+            return false;
+        }
+
+        // tests look it up by name to watch what is played
+        sink->set_name("sink");
+
+        if (audioSink == "fakesink")
+        {
+            // play in real time instead of as fast as possible
+            sink->set_property("sync", true);
+        }
+
+        // autoaudiosink only creates the real sink when it goes to READY
+        configureSink(sink);
+        if (auto bin = Glib::RefPtr<Gst::Bin>::cast_dynamic(sink))
+        {
+            bin->signal_element_added().connect([](const Glib::RefPtr<Gst::Element>& element)
+            {
+                configureSink(element);
+            });
+        }
+
+        // limited by time alone, the buffer count and byte limits are turned off
+        queue->property_max_size_time() = static_cast<guint64>(latencyProfile->queueTime);
+        queue->property_max_size_buffers() = 0;
+        queue->property_max_size_bytes() = 0;
+        queue->signal_underrun().connect([]
+        {
+            if (playing && flowing.exchange(false) && !ending)
+            {
+                queueUnderruns++;
+            }
+        });
+        queue->get_static_pad("src")->add_probe(Gst::PAD_PROBE_TYPE_BUFFER,
+                [](const Glib::RefPtr<Gst::Pad>&, const Gst::PadProbeInfo&)
+        {
+            flowing = true;
+            return Gst::PAD_PROBE_OK;
+        });
+        queue->get_static_pad("sink")->add_probe(Gst::PAD_PROBE_TYPE_EVENT_DOWNSTREAM | Gst::PAD_PROBE_TYPE_EVENT_FLUSH,
+                [](const Glib::RefPtr<Gst::Pad>&, const Gst::PadProbeInfo& info)
+        {
+            switch (info.get_event()->get_event_type())
+            {
+                case Gst::EVENT_FLUSH_START:
+                    flowing = false;
+                    ending = false;
+                    break;
+                case Gst::EVENT_STREAM_START:
+                    ending = false;
+                    break;
+                case Gst::EVENT_EOS:
+                    ending = true;
+                    break;
+                default:
+                    break;
+            }
+            return Gst::PAD_PROBE_OK;
+        });
+
+        log(LT::info, "Latency profile %s") % latencyProfile->name;
+
+        pipeline->add(input)->add(conv)->add(resample)->add(queue)->add(sink);
+        input->link(conv);
+        conv->link(resample);
+        resample->link(queue);
+        queue->link(sink);
+
+        sink->get_static_pad("sink")->add_probe(Gst::PAD_PROBE_TYPE_BUFFER,
+                [](const Glib::RefPtr<Gst::Pad>&, const Gst::PadProbeInfo&)
+        {
+            if (switchPending.exchange(false))
+            {
+                switchTookName = switchName.load();
+                switchTookCpu = cpuNs() - switchStartCpu;
+                switchTook = nowNs() - switchStart;
+                notify();
+            }
+            return Gst::PAD_PROBE_OK;
+        });
+
+        // messages are still queued on the bus, the handler only
+        // tells the playback thread that there is something to pop
+        pipeline->get_bus()->set_sync_handler([](const Glib::RefPtr<Gst::Bus>&, const Glib::RefPtr<Gst::Message>&)
+        {
+            notify();
+            return Gst::BUS_PASS;
+        });
+
+        // READY opens the audio device, it stays open until end()
+        pipeline->set_state(Gst::STATE_READY);
+        return true;
+    }
+
+    void notify()
+    {
+        if (onEvent)
+        {
+            onEvent();
+        }
+    }
+
+    void end()
+    {
+        if (pipeline)
+        {
+            aooutput::beginFlush();
+            pipeline->set_state(Gst::STATE_NULL);
+            pipeline->get_bus()->unset_sync_handler();
+        }
+
+        if (pipeline)
+        {
+            stopPlayTime();
+            LatencyStats stats = latencyStats();
+            log(LT::info, "Latency profile %s: %u underruns in %.0f s of playback")
+                % stats.profile % stats.underruns % (stats.played / 1e9);
+        }
+
+        aooutput::end();
+        attachedBins.clear();
+        failedBins.clear();
+        sink.reset();
+        queue.reset();
+        resample.reset();
+        conv.reset();
+        input.reset();
+        pipeline.reset();
+    }
+
+    bool attach(data::OpenedTrack& track)
+    {
+        if (!pipeline || !track.isValid())
+        {
+            return false;
+        }
+
+        auto inputPad = input->get_request_pad("sink_%u");
+        if (!inputPad)
+        {
+            log(LT::error, "Could not get an input pad for %s") % track.filepath;
+            return false;
+        }
+
+        if (crossfadeEnabled())
+        {
+            // the mixer plays everything that is attached at once,
+            // so the track has to start where the output is now
+            // instead of at the beginning of the pipeline's running time
+            // and fade in over whatever is already playing
+            track.pad->set_offset(runningTime());
+            inputPad->set_property("volume", inputPads.empty() ? 1.0 : 0.0);
+        }
+
+        pipeline->add(track.bin);
+        if (track.pad->link(inputPad) != Gst::PAD_LINK_OK)
+        {
+            log(LT::error, "Could not link %s to the output") % track.filepath;
+            pipeline->remove(track.bin);
+            input->release_request_pad(inputPad);
+            return false;
+        }
+
+        track.outputPad = inputPad;
+        attachedBins.push_back(GST_OBJECT(track.bin->gobj()));
+        playstats::attached(track);
+        track.bin->sync_state_with_parent();
+        inputPads.push_back(inputPad);
+        attachedEver++;
+        log(LT::debug, "Attached %s, %u track sources built so far") % track.filepath % attachedEver;
+        return true;
+    }
+
+    void detach(data::OpenedTrack& track)
+    {
+        if (!track.outputPad)
+        {
+            return;
+        }
+        playstats::detached(track);
+
+        // if this was the active pad, concat switches to the next one
+        track.bin->set_state(Gst::STATE_NULL);
+        track.pad->unlink(track.outputPad);
+        input->release_request_pad(track.outputPad);
+        pipeline->remove(track.bin);
+        inputPads.remove(track.outputPad);
+        attachedBins.remove(GST_OBJECT(track.bin->gobj()));
+        failedBins.remove(GST_OBJECT(track.bin->gobj()));
+        track.outputPad.reset();
+
+        // a crossfade that was cut short must not leave the rest quiet
+        if (crossfadeEnabled() && inputPads.size() == 1)
+        {
+            inputPads.front()->set_property("volume", 1.0);
+        }
+    }
+
+    size_t attachedCount()
+    {
+        return inputPads.size();
+    }
+
+    size_t attachedTotal()
+    {
+        return attachedEver;
+    }
+
+    void reset()
+    {
+        // READY flushes everything, but unlike NULL keeps the device open.
+        // attached tracks start from the beginning on the next play()
+        playing = false;
+        stopPlayTime();
+        aooutput::beginFlush();
+        pipeline->set_state(Gst::STATE_READY);
+        aooutput::endFlush();
+        aooutput::setPlaying(false);
+        flowing = false;
+        ending = false;
+    }
+
+    void play()
+    {
+        pipeline->set_state(Gst::STATE_PLAYING);
+        aooutput::setPlaying(true);
+        playing = true;
+        int64_t none = 0;
+        playStart.compare_exchange_strong(none, nowNs());
+    }
+
+    void pause()
+    {
+        // running dry because the sink stopped taking data is not an underrun
+        playing = false;
+        stopPlayTime();
+        aooutput::setPlaying(false);
+        pipeline->set_state(Gst::STATE_PAUSED);
+    }
+
+    LatencyStats latencyStats()
+    {
+        LatencyStats ret;
+        ret.profile = latencyProfile->name;
+
+        int64_t start = playStart;
+        ret.played = playedBefore + (start ? nowNs() - start : 0);
+
+        ret.underruns = underruns();
+        if (audioSink == "ao")
+        {
+            ret.latency = aooutput::stats().fillTime;
+        }
+        else
+        {
+            // what the sink reports once it runs, its buffer-time until then
+            ret.latency = sinkBufferTime * Gst::MICRO_SECOND;
+
+            if (pipeline)
+            {
+                GstQuery* query = gst_query_new_latency();
+                if (gst_element_query(GST_ELEMENT(pipeline->gobj()), query))
+                {
+                    gboolean live;
+                    GstClockTime minLatency, maxLatency;
+                    gst_query_parse_latency(query, &live, &minLatency, &maxLatency);
+                    if (minLatency != GST_CLOCK_TIME_NONE && minLatency > 0)
+                    {
+                        ret.latency = minLatency;
+                    }
+                }
+                gst_query_unref(query);
+            }
+        }
+
+        if (queue)
+        {
+            ret.latency += static_cast<gint64>(static_cast<guint64>(queue->property_current_level_time()));
+        }
+        return ret;
+    }
+
+    uint64_t underruns()
+    {
+        return audioSink == "ao" ? aooutput::stats().underruns : queueUnderruns.load();
+    }
+
+    bool processMessages(const data::OpenedTrack& current)
+    {
+        bool ok = true;
+        GstObject* currentBin = current.bin ? GST_OBJECT(current.bin->gobj()) : nullptr;
+
+        int64_t took = switchTook.exchange(-1);
+        if (took >= 0)
+        {
+            log(LT::debug, "%s took %.2f ms, %.2f ms of CPU")
+                % switchTookName.load() % (took / 1e6) % (switchTookCpu / 1e6);
+        }
+        uint64_t count = underruns();
+        if (count != loggedUnderruns)
+        {
+            log(LT::debug, "Output ran dry, %u times so far") % count;
+            loggedUnderruns = count;
+        }
+
+        auto bus = pipeline->get_bus();
+        while (auto message = bus->pop())
+        {
+            playstats::message(message);
+
+            // messages from the track that is waiting or fading in do not stop the current one
+            auto type = message->get_message_type();
+            GstObject* bin = type == Gst::MESSAGE_EOS || type == Gst::MESSAGE_ERROR ? sourceBin(message) : nullptr;
+            bool other = bin && bin != currentBin;
+
+            switch (type)
+            {
+                case Gst::MESSAGE_EOS:
+                    ok = ok && other;
+                    break;
+
+                case Gst::MESSAGE_ERROR:
+                    {
+                        Glib::Error error;
+                        string debug;
+                        Glib::RefPtr<Gst::MessageError>::cast_static(message)->parse(error, debug);
+                        log(LT::error, "%s: %s") % message->get_source()->get_name() % error.what();
+                        if (other)
+                        {
+                            if (find(failedBins.begin(), failedBins.end(), bin) == failedBins.end())
+                            {
+                                failedBins.push_back(bin);
+                            }
+                        }
+                        else
+                        {
+                            ok = false;
+                        }
+                    }
+                    break;
+
+                case Gst::MESSAGE_WARNING:
+                    {
+                        Glib::Error error;
+                        string debug;
+                        Glib::RefPtr<Gst::MessageWarning>::cast_static(message)->parse(error, debug);
+                        log(LT::warning, "%s: %s") % message->get_source()->get_name() % error.what();
+                    }
+                    break;
+
+                default:
+                    break;
+            }
+        }
+
+        return ok;
+    }
+
+    bool failed(const data::OpenedTrack& track)
+    {
+        if (!track.outputPad)
+        {
+            return false;
+        }
+        GstObject* bin = GST_OBJECT(track.bin->gobj());
+        return find(failedBins.begin(), failedBins.end(), bin) != failedBins.end();
+    }
+
+    bool queryPosition(const data::OpenedTrack& track, gint64& position)
+    {
+        // the output position is what is audible, but with crossfade it counts
+        // from the start of the first track, so the track's offset is taken out
+        if (!pipeline->query_position(Gst::FORMAT_TIME, position))
+        {
+            return false;
+        }
+        position = max<gint64>(position - track.pad->get_offset(), 0);
+        return true;
+    }
+
+    bool queryDuration(const data::OpenedTrack& track, gint64& duration)
+    {
+        return track.pad->query_duration(Gst::FORMAT_TIME, duration);
+    }
+
+    bool crossfadeEnabled()
+    {
+        return crossfade > 0;
+    }
+
+    void fade(double progress)
+    {
+        if (inputPads.size() < 2)
+        {
+            return;
+        }
+
+        progress = min(max(progress, 0.0), 1.0);
+        inputPads.front()->set_property("volume", 1.0 - progress);
+        inputPads.back()->set_property("volume", progress);
+    }
+
+    bool seek(const data::OpenedTrack& track, gint64 position, bool accurate)
+    {
+        if (crossfadeEnabled())
+        {
+            // the mixer would send the same position to both tracks
+            if (inputPads.size() > 1)
+            {
+                log(LT::debug, "Not seeking in the middle of a crossfade");
+                return false;
+            }
+
+            // a flushing seek starts the running time over,
+            // so the track does not need to be shifted anymore
+            track.pad->set_offset(0);
+        }
+
+        Gst::SeekFlags flags = Gst::SEEK_FLAG_FLUSH;
+        flags |= accurate ? Gst::SEEK_FLAG_ACCURATE : Gst::SEEK_FLAG_KEY_UNIT | Gst::SEEK_FLAG_SNAP_NEAREST;
+
+        markSwitch(accurate ? "Accurate seek" : "Seek");
+        if (!pipeline->seek(Gst::FORMAT_TIME, flags, max<gint64>(position, 0)))
+        {
+            switchPending = false;
+            log(LT::warning, "Could not seek to %.3f s") % (position / 1e9);
+            return false;
+        }
+        return true;
+    }
+
+    void markSwitch(const char* name)
+    {
+        switchName = name;
+        switchStart = nowNs();
+        switchStartCpu = cpuNs();
+        switchPending = true;
+    }
+}
@@ -0,0 +1,416 @@
+#include "pcm_cache.hpp"
+#include "log.hpp"
+
+#include <list>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <unordered_map>
+#include <cstdlib>
+
+using namespace std;
+
+namespace pcmcache
+{
+    size_t memoryLimit = 256 * 1024 * 1024;
+    size_t trackLimit  = 128 * 1024 * 1024;
+
+    namespace
+    {
+        // audio is copied into blocks of this size, a buffer that does not
+        // fit into the rest of the last one starts a new one. what is
+        // recorded is never moved, and memory is counted as it is allocated
+        const size_t blockSize = 256 * 1024;
+
+        struct Block
+        {
+            unique_ptr<guint8[]> data;
+            size_t size = 0;
+            size_t used = 0;
+        };
+
+        // one buffer as it left the track's bin
+        struct Chunk
+        {
+            guint64 pts;
+            guint64 duration;
+            size_t  block;
+            size_t  offset;
+            size_t  size;
+        };
+
+        struct Entry
+        {
+            uint64_t trackId = 0;
+            Glib::RefPtr<Gst::Caps> caps;
+            vector<Block>  blocks;
+            vector<Chunk>  chunks;
+            // allocated for blocks
+            size_t bytes = 0;
+            // end of the last chunk
+            guint64 duration = 0;
+            // of the whole track, 0 if the decoder did not know
+            gint64 trackDuration = 0;
+            // false if only the beginning of the track was recorded
+            bool complete = false;
+        };
+
+        void finishRecording(shared_ptr<Entry> entry, size_t counted);
+
+        // filled from the streaming thread of the track
+        struct Recording
+        {
+            shared_ptr<Entry> entry = make_shared<Entry>();
+            bool abandoned = false;
+            // bytes of it counted in recordingBytes
+            size_t counted = 0;
+
+            // keeps what was recorded so far, the whole track if complete
+            void finish(bool complete)
+            {
+                abandoned = true;
+                if (entry)
+                {
+                    entry->complete = complete;
+                    finishRecording(move(entry), counted);
+                    entry.reset();
+                }
+                counted = 0;
+            }
+
+            // a track that is skipped or stopped is never told,
+            // its probe goes away with its bin
+            ~Recording()
+            {
+                if (!abandoned)
+                {
+                    finish(false);
+                }
+            }
+        };
+
+        // position of one source in the entry it plays,
+        // appsrc calls need-data and seek-data from its streaming thread
+        struct Reader
+        {
+            shared_ptr<const Entry> entry;
+            atomic<size_t> next{ 0 };
+        };
+
+        mutex cacheMutex;
+        // most recently used first
+        list<shared_ptr<const Entry>> entries;
+        unordered_map<uint64_t, list<shared_ptr<const Entry>>::iterator> entriesById;
+        size_t   bytes  = 0;
+        // recordings that are not finished yet count against the limit too
+        size_t   recordingBytes = 0;
+        uint64_t hits   = 0;
+        uint64_t misses = 0;
+
+        size_t mebibytes(const char* name, size_t fallback)
+        {
+            const char* value = getenv(name);
+            if (!value)
+            {
+                return fallback;
+            }
+            return static_cast<size_t>(max(atof(value), 0.0) * 1024 * 1024);
+        }
+
+        // cacheMutex must be held
+        void dropEntry(uint64_t trackId)
+        {
+            auto iter = entriesById.find(trackId);
+            if (iter == entriesById.end())
+            {
+                return;
+            }
+            bytes -= (*iter->second)->bytes;
+            entries.erase(iter->second);
+            entriesById.erase(iter);
+        }
+
+        // cacheMutex must be held. drops the least recently used entries
+        // until size more bytes fit, returns false if they can not
+        bool makeRoom(size_t size)
+        {
+            while (bytes + recordingBytes + size > memoryLimit && !entries.empty())
+            {
+                dropEntry(entries.back()->trackId);
+            }
+            return bytes + recordingBytes + size <= memoryLimit;
+        }
+
+        // called for every block before it is allocated
+        bool reserve(Recording& recording, size_t size)
+        {
+            lock_guard<mutex> lock(cacheMutex);
+            if (!makeRoom(size))
+            {
+                return false;
+            }
+            recordingBytes += size;
+            recording.counted += size;
+            return true;
+        }
+
+        void finishRecording(shared_ptr<Entry> entry, size_t counted)
+        {
+            lock_guard<mutex> lock(cacheMutex);
+            recordingBytes -= counted;
+
+            // the beginning has to be there for a partial entry to be of use
+            if (entry->chunks.empty() || (!entry->complete && entry->chunks.front().pts != 0))
+            {
+                return;
+            }
+
+            // a shorter recording does not replace what is already kept
+            auto iter = entriesById.find(entry->trackId);
+            if (iter != entriesById.end())
+            {
+                const Entry& kept = **iter->second;
+                if (kept.complete || (!entry->complete && kept.duration >= entry->duration))
+                {
+                    return;
+                }
+                dropEntry(entry->trackId);
+            }
+
+            entry->chunks.shrink_to_fit();
+            size_t size = entry->bytes;
+            if (!makeRoom(size))
+            {
+                return;
+            }
+
+            entries.push_front(entry);
+            entriesById[entry->trackId] = entries.begin();
+            bytes += size;
+            log(LT::debug, "Cached %u KiB of decoded audio%s, %u KiB in %u tracks")
+                % (size / 1024) % (entry->complete ? "" : " (the beginning)") % (bytes / 1024) % entries.size();
+        }
+
+        void releaseReader(gpointer reader)
+        {
+            delete static_cast<shared_ptr<Reader>*>(reader);
+        }
+    }
+
+    void init()
+    {
+        memoryLimit = mebibytes("PLAYER_PCM_CACHE", memoryLimit);
+        trackLimit  = min(mebibytes("PLAYER_PCM_CACHE_TRACK", trackLimit), memoryLimit);
+    }
+
+    void end()
+    {
+        Stats current = stats();
+        log(LT::info, "Decoded audio cache: %u hits, %u misses, %u KiB in %u tracks")
+            % current.hits % current.misses % (current.bytes / 1024) % current.tracks;
+
+        lock_guard<mutex> lock(cacheMutex);
+        entries.clear();
+        entriesById.clear();
+        bytes = 0;
+    }
+
+    bool enabled()
+    {
+        return memoryLimit > 0;
+    }
+
+    Glib::RefPtr<Gst::Element> createSource(uint64_t trackId, guint64& cachedUntil)
+    {
+        cachedUntil = Gst::CLOCK_TIME_NONE;
+        if (!enabled())
+        {
+            return {};
+        }
+
+        auto reader = make_shared<Reader>();
+        {
+            lock_guard<mutex> lock(cacheMutex);
+            auto iter = entriesById.find(trackId);
+            if (iter == entriesById.end())
+            {
+                return {};
+            }
+            entries.splice(entries.begin(), entries, iter->second);
+            reader->entry = *iter->second;
+        }
+
+        auto src = Gst::AppSrc::create();
+        if (!src)
+        {
+            return {};
+        }
+        const Entry& entry = *reader->entry;
+        if (!entry.complete)
+        {
+            cachedUntil = entry.duration;
+        }
+        src->set_caps(entry.caps);
+        src->set_property("format", Gst::FORMAT_TIME);
+        // what the track reports, not only the part that is kept
+        src->set_property("duration", entry.trackDuration > 0 ? static_cast<guint64>(entry.trackDuration) : entry.duration);
+        src->set_stream_type(Gst::APP_STREAM_TYPE_SEEKABLE);
+
+        // the handlers belong to the source, so they must not hold a reference to it
+        Gst::AppSrc* source = src.operator->();
+
+        src->signal_need_data().connect([source, reader](guint)
+        {
+            const Entry& entry = *reader->entry;
+            size_t next = reader->next++;
+            if (next >= entry.chunks.size())
+            {
+                source->end_of_stream();
+                return;
+            }
+
+            // every buffer holds a reference to the entry, which is never written to again
+            const Chunk& chunk = entry.chunks[next];
+            const Block& block = entry.blocks[chunk.block];
+            GstBuffer* buffer = gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY,
+                    block.data.get(), block.size, chunk.offset, chunk.size,
+                    new shared_ptr<Reader>(reader), releaseReader);
+            GST_BUFFER_PTS(buffer) = chunk.pts;
+            GST_BUFFER_DURATION(buffer) = chunk.duration;
+            source->push_buffer(Glib::wrap(buffer, false));
+        });
+
+        // in time format the offset is a position in nanoseconds
+        src->signal_seek_data().connect([reader](guint64 position)
+        {
+            const auto& chunks = reader->entry->chunks;
+            auto chunk = partition_point(chunks.begin(), chunks.end(), [position](const Chunk& chunk)
+            {
+                return chunk.pts + chunk.duration <= position;
+            });
+            reader->next = chunk - chunks.begin();
+            return true;
+        });
+
+        return src;
+    }
+
+    void record(data::OpenedTrack& track)
+    {
+        if (!enabled() || track.cached || !track.isValid())
+        {
+            return;
+        }
+
+        auto recording = make_shared<Recording>();
+        recording->entry->trackId = track.parent->id;
+
+        // the gain is applied after the recording, it can change
+        // once the album is measured
+        auto recorded = track.volume ? track.volume->get_static_pad("sink") : Glib::RefPtr<Gst::Pad>(track.pad);
+        auto trackPad = track.pad;
+        recorded->add_probe(Gst::PAD_PROBE_TYPE_BUFFER | Gst::PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+                [recording, trackPad](const Glib::RefPtr<Gst::Pad>& pad, const Gst::PadProbeInfo& info)
+        {
+            if (recording->abandoned)
+            {
+                return Gst::PAD_PROBE_REMOVE;
+            }
+            Entry& entry = *recording->entry;
+
+            if (auto event = info.get_event())
+            {
+                switch (event->get_event_type())
+                {
+                    case Gst::EVENT_EOS:
+                        recording->finish(true);
+                        break;
+
+                    // the chunks are all played with the caps they started with
+                    case Gst::EVENT_CAPS:
+                        if (!entry.chunks.empty())
+                        {
+                            recording->finish(false);
+                        }
+                        break;
+
+                    // a seek, what was recorded up to it is still the beginning of the track
+                    case Gst::EVENT_FLUSH_START:
+                    case Gst::EVENT_FLUSH_STOP:
+                        recording->finish(false);
+                        break;
+
+                    default:
+                        break;
+                }
+            }
+            else if (auto buffer = info.get_buffer())
+            {
+                GstBuffer* data = buffer->gobj();
+                size_t size = gst_buffer_get_size(data);
+                bool fits = !entry.blocks.empty() && entry.blocks.back().size - entry.blocks.back().used >= size;
+                size_t allocated = fits ? 0 : max(size, blockSize);
+                if (!GST_BUFFER_PTS_IS_VALID(data) || !GST_BUFFER_DURATION_IS_VALID(data)
+                        || entry.bytes + allocated > trackLimit || (allocated && !reserve(*recording, allocated)))
+                {
+                    recording->finish(false);
+                }
+                else
+                {
+                    if (allocated)
+                    {
+                        Block block;
+                        block.data.reset(new guint8[allocated]);
+                        block.size = allocated;
+                        entry.blocks.push_back(move(block));
+                        entry.bytes += allocated;
+                    }
+                    if (!entry.caps)
+                    {
+                        entry.caps = pad->get_current_caps();
+                        gint64 duration;
+                        if (trackPad->query_duration(Gst::FORMAT_TIME, duration))
+                        {
+                            entry.trackDuration = duration;
+                        }
+                    }
+
+                    Block& block = entry.blocks.back();
+                    Chunk chunk = { GST_BUFFER_PTS(data), GST_BUFFER_DURATION(data), entry.blocks.size() - 1, block.used, size };
+                    gst_buffer_extract(data, 0, block.data.get() + block.used, size);
+                    block.used += size;
+                    entry.chunks.push_back(chunk);
+                    entry.duration = chunk.pts + chunk.duration;
+                }
+            }
+
+            return recording->abandoned ? Gst::PAD_PROBE_REMOVE : Gst::PAD_PROBE_OK;
+        });
+    }
+
+    void started(const data::OpenedTrack& track)
+    {
+        lock_guard<mutex> lock(cacheMutex);
+        if (track.cached || track.cachedUntil != Gst::CLOCK_TIME_NONE)
+        {
+            hits++;
+        }
+        else if (enabled())
+        {
+            misses++;
+        }
+    }
+
+    Stats stats()
+    {
+        lock_guard<mutex> lock(cacheMutex);
+        Stats ret;
+        ret.hits   = hits;
+        ret.misses = misses;
+        ret.tracks = entries.size();
+        ret.bytes  = bytes;
+        return ret;
+    }
+}
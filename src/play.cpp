@@ -1,5 +1,10 @@
 #include "play.hpp"
 #include "log.hpp"
+#include "history.hpp"
+#include "output.hpp"
+#include "prefetch.hpp"
+#include "pcm_cache.hpp"
+#include "play_stats.hpp"
 
 #include <iostream>
 #include <algorithm>
@@ -7,10 +12,8 @@
 #include <iterator>
 #include <thread>
 #include <chrono>
-#include <random>
-#include <tuple>
+#include <condition_variable>
 
-#include <stack>
 #include <deque>
 #include <vector>
 
@@ -26,415 +29,742 @@ using data::Artist;
 
 namespace playback
 {
-    shared_ptr<Track> NowPlaying::track;
-    bool              NowPlaying::playing = false;
-    gint64              NowPlaying::duration = 0;
-    gint64              NowPlaying::current = 0;
+    // state of the playback thread, nothing else touches it.
+    // other threads read what is published with publishNowPlaying()
+    namespace NowPlaying
+    {
+        shared_ptr<Track> track;
+        bool              playing = false;
+        gint64            duration = 0;
+        gint64            current = 0;
+
+        void reset()
+        {
+            track.reset();
+            playing = false;
+            duration = 0;
+            current = 0;
+        }
+    }
 
 
-    queue<unique_ptr<Command>>           playbackControl;
-    mutex                                playbackControlMutex;
+    MpscQueue<Command>                   playbackControl(1024);
     bool                                 playbackPause = false;
     thread playbackThread;
 
+    // only refreshes NowPlaying::current, everything else wakes the thread up
+    const auto positionInterval = 100ms;
+    // volume steps during a crossfade
+    const auto fadeInterval = 20ms;
+
+    mutex              wakeupMutex;
+    condition_variable wakeupCondition;
+    bool               wakeupPending = false;
+
     void init()
     {
+        output::onEvent = wakePlaybackThread;
+        playstats::init();
+        if (!output::init())
+        {
+            log(LT::error, "Could not create audio output");
+        }
         playbackThread = thread(playbackThreadFunc);
     }
 
     void end()
     {
-        sendPlaybackCommand(new CommandEXIT());
+        sendPlaybackCommand(CommandType::exit);
         playbackThread.join();
+        output::end();
+
+        Command command;
+        while (playbackControl.pop(command))
+        {
+        }
+    }
+
+    namespace
+    {
+        // zero timeout means wait until woken up
+        void waitForEvent(steady_clock::duration timeout)
+        {
+            unique_lock<mutex> lock(wakeupMutex);
+            if (timeout == steady_clock::duration::zero())
+            {
+                wakeupCondition.wait(lock, [] { return wakeupPending; });
+            }
+            else
+            {
+                wakeupCondition.wait_for(lock, timeout, [] { return wakeupPending; });
+            }
+            wakeupPending = false;
+        }
+
+        // commands that were taken from playbackControl but not acted upon yet.
+        // only the playback thread touches it
+        deque<Command> pendingCommands;
+
+        bool isSkip(CommandType type)
+        {
+            return type == CommandType::next || type == CommandType::previous;
+        }
+
+        bool isPauseChange(CommandType type)
+        {
+            return type == CommandType::pause || type == CommandType::resume || type == CommandType::toggle;
+        }
+
+        // nothing to seek to in between, relative seeks are
+        // applied to the position that was last requested
+        gint64 seekPosition = -1;
+
+        Seqlock<NowPlayingSnapshot> nowPlayingSnapshot;
+        size_t queueLength = 0;
+        size_t queueIndex = 0;
+
+        void publishNowPlaying()
+        {
+            NowPlayingSnapshot snapshot;
+            if (NowPlaying::track)
+            {
+                snapshot.track = NowPlaying::track.get();
+                snapshot.trackId = NowPlaying::track->id;
+            }
+            snapshot.position = NowPlaying::current;
+            snapshot.duration = NowPlaying::duration;
+            if (NowPlaying::playing)
+            {
+                snapshot.state = playbackPause ? PlaybackState::paused : PlaybackState::playing;
+            }
+            snapshot.queueLength = queueLength;
+            snapshot.queueIndex = queueIndex;
 
-        while (!playbackControl.empty())
+            nowPlayingSnapshot.store(snapshot);
+        }
+
+        // only the next track is opened ahead of time (see preroll),
+        // but a few more can at least be read into the page cache
+        void prefetchUpcoming(const PlaybackQueue& queue)
         {
-            playbackControl.pop();
+            vector<string> paths;
+            for (auto& track : queue.upcoming(prefetch::lookahead))
+            {
+                paths.push_back(track->filepath);
+            }
+            prefetch::upcoming(move(paths));
+        }
+
+        shared_ptr<const PlaybackQueue::Snapshot> queueSnapshot = make_shared<PlaybackQueue::Snapshot>();
+        uint64_t publishedQueueVersion = numeric_limits<uint64_t>::max();
+
+        // copying the queue is not free, so it only happens when it has changed
+        void publishQueue(const PlaybackQueue& queue)
+        {
+            if (queue.version() == publishedQueueVersion)
+            {
+                return;
+            }
+            publishedQueueVersion = queue.version();
+            atomic_store(&queueSnapshot, shared_ptr<const PlaybackQueue::Snapshot>(make_shared<PlaybackQueue::Snapshot>(queue.snapshot())));
+        }
+
+        // shuffling is left to the queue, which does not need to copy the tracks for it
+        PlaybackQueue::Order orderOf(const PlaybackOptions& options)
+        {
+            if (!(options & PlaybackOption::shuffle))
+            {
+                return PlaybackQueue::Order::asGiven;
+            }
+            if (options & PlaybackOption::spreadArtists)
+            {
+                return PlaybackQueue::Order::shuffledSpreadArtists;
+            }
+            return PlaybackQueue::Order::shuffled;
+        }
+
+        // stops the current track right away instead of letting
+        // the audio that is already buffered play out
+        void interrupt(data::OpenedTrack& opened)
+        {
+            output::markSwitch();
+            output::reset();
+            opened.markAsInvalid();
         }
     }
 
-    unique_ptr<Command> playTrack(data::OpenedTrack& track)
+    Command playTrack(data::OpenedTrack& track, const function<void()>& attachNext, const function<void()>& dropFailed)
     {
         cout << "\033]0;" << track.parent->name << "\007\n";
 
-        track.pipeline->set_state(Gst::STATE_PLAYING);
+        playstats::current(track);
+        output::play();
+        seekPosition = -1;
+
+        // gapless playback attaches the next track right away and concat
+        // holds it back, the mixer would play it immediately
+        bool nextAttached = false;
+        if (attachNext && !output::crossfadeEnabled())
+        {
+            attachNext();
+            nextAttached = true;
+        }
 
         while (true)
         {
-            unique_ptr<Command> command = getPlaybackCommand();
-            if (command)
+            Command command;
+            while (getPlaybackCommand(command))
             {
-                switch (command->type())
+                switch (command.type)
                 {
                     case CommandType::pause:
                         playbackPause = true;
-                        track.pipeline->set_state(Gst::STATE_PAUSED);
+                        output::pause();
                         break;
                     case CommandType::resume:
-                        track.pipeline->set_state(Gst::STATE_PLAYING);
+                        output::play();
                         playbackPause = false;
                         break;
                     case CommandType::toggle:
                         playbackPause = !playbackPause;
                         if (playbackPause)
                         {
-                            track.pipeline->set_state(Gst::STATE_PAUSED);
+                            output::pause();
                         }
                         else
                         {
-                            track.pipeline->set_state(Gst::STATE_PLAYING);
+                            output::play();
+                        }
+                        break;
+                    case CommandType::seek:
+                        {
+                            gint64 target = command.seekTo;
+                            if (command.seekRelative)
+                            {
+                                target += seekPosition >= 0 ? seekPosition : NowPlaying::current;
+                            }
+                            if (NowPlaying::duration > 0)
+                            {
+                                target = min(target, NowPlaying::duration);
+                            }
+                            target = max<gint64>(target, 0);
+
+                            // concat would only seek in the part that is playing,
+                            // the track is opened again from the file for it
+                            if (track.cachedUntil != Gst::CLOCK_TIME_NONE)
+                            {
+                                command.seekTo = target;
+                                command.seekRelative = false;
+                                output::pause();
+                                cout << "\033]0;" << "player" << "\007\n";
+                                return command;
+                            }
+
+                            if (output::seek(track, target, command.seekAccurate))
+                            {
+                                seekPosition = target;
+                                NowPlaying::current = target;
+                            }
                         }
                         break;
 
                     default:
-                        track.pipeline->set_state(Gst::STATE_PAUSED);
+                        output::pause();
                         cout << "\033]0;" << "player" << "\007\n";
                         return command;
                 }
             }
 
-            if (track.pipeline->get_bus()->poll(Gst::MESSAGE_EOS, 0))
+            // with the next track attached concat switches to it by itself,
+            // otherwise the whole pipeline reaches EOS once the sink
+            // has played everything and has to be reset
+            bool outputOk = output::processMessages(track);
+            if (dropFailed)
+            {
+                dropFailed();
+            }
+            if (!outputOk || (track.finished() && output::attachedCount() > 1))
             {
+                if (!outputOk)
+                {
+                    output::reset();
+                }
                 track.markAsInvalid();
                 cout << "\033]0;" << "player" << "\007\n";
-                return {};
+                return CommandType::none;
             }
 
-            track.pipeline->query_position(Gst::FORMAT_TIME, NowPlaying::current);
-            track.pipeline->query_duration(Gst::FORMAT_TIME, NowPlaying::duration);
+            // right after a flushing seek the position is not known yet
+            gint64 position;
+            if (output::queryPosition(track, position))
+            {
+                NowPlaying::current = position;
+                seekPosition = -1;
+            }
+            output::queryDuration(track, NowPlaying::duration);
+            publishNowPlaying();
+            playstats::tick();
 
-            this_thread::sleep_for(50ms);
+            bool fading = false;
+            if (output::crossfadeEnabled() && !playbackPause && NowPlaying::duration > 0)
+            {
+                gint64 left = NowPlaying::duration - NowPlaying::current;
+                if (left <= output::crossfade)
+                {
+                    if (!nextAttached && attachNext)
+                    {
+                        attachNext();
+                        nextAttached = true;
+                    }
+                    output::fade(1.0 - static_cast<double>(left) / output::crossfade);
+                    fading = output::attachedCount() > 1;
+                }
+            }
+
+            steady_clock::duration timeout = fading ? steady_clock::duration(fadeInterval) : steady_clock::duration(positionInterval);
+            waitForEvent(playbackPause ? steady_clock::duration::zero() : timeout);
         }
     }
 
+    // listing the tracks is left to the playback thread,
+    // where a play that is replaced right away never gets that far
     void startPlayback(shared_ptr<Artist> artist, PlaybackOptions options)
     {
-        list<shared_ptr<Track>> playbackList = artist->getTracks();
-
-        if (options & PlaybackOption::shuffle)
-        {
-            vector<shared_ptr<Track>> temp(make_move_iterator(playbackList.begin()), make_move_iterator(playbackList.end()));
-            playbackList.clear();
-
-            shuffle(temp.begin(), temp.end(), default_random_engine(system_clock::now().time_since_epoch().count()));
-
-            playbackList = { make_move_iterator(temp.begin()), make_move_iterator(temp.end()) };
-        }
-
-        if (playbackList.empty())
-        {
-            return;
-        }
-
-        sendPlaybackCommand(new CommandPLAY(move(playbackList), options));
+        Command command = Command::play({}, options);
+        command.artist = move(artist);
+        sendPlaybackCommand(move(command));
     }
 
     void startPlayback(shared_ptr<Album> album, PlaybackOptions options)
     {
-        list<shared_ptr<Track>> playbackList = album->getTracks();
-
-        if (options & PlaybackOption::shuffle)
-        {
-            vector<shared_ptr<Track>> temp(make_move_iterator(playbackList.begin()), make_move_iterator(playbackList.end()));
-            playbackList.clear();
-
-            shuffle(temp.begin(), temp.end(), default_random_engine(system_clock::now().time_since_epoch().count()));
-
-            playbackList = { make_move_iterator(temp.begin()), make_move_iterator(temp.end()) };
-        }
-
-
-        if (playbackList.empty())
-        {
-            return;
-        }
-
-        sendPlaybackCommand(new CommandPLAY(move(playbackList), options));
+        Command command = Command::play({}, options);
+        command.album = move(album);
+        sendPlaybackCommand(move(command));
     }
 
     void startPlayback(shared_ptr<Track> track, PlaybackOptions options)
     {
-        sendPlaybackCommand(new CommandPLAY({track}, options));
+        sendPlaybackCommand(Command::play({track}, options));
     }
 
     void startPlayback(shared_ptr<Playlist> playlist, PlaybackOptions options)
     {
-        sendPlaybackCommand(new CommandPLAY(playlist->getTracks(), options));
+        sendPlaybackCommand(Command::play(playlist->getTracks(), options));
     }
 
-    unique_ptr<CommandPLAY> playbackThreadWait()
+    bool playbackThreadWait(Command& play)
     {
         while (true)
         {
-            while (!playbackControl.empty())
+            Command command;
+            while (getPlaybackCommand(command))
             {
-                playbackControlMutex.lock();
-                unique_ptr<Command> command = move(playbackControl.front());
-                playbackControl.pop();
-                playbackControlMutex.unlock();
-
-                switch (command->type())
+                switch (command.type)
                 {
-                    case CommandType::play: //TODO: provide reliable way to make sure command is actually PlayCommand in this case
-                            return unique_ptr<CommandPLAY>(dynamic_cast<CommandPLAY*>(command.release()));
+                    case CommandType::play:
+                        play = move(command);
+                        return true;
                     case CommandType::exit:
-                        return {};
+                        return false;
                     default:
                         break;
                 }
             }
 
-            this_thread::sleep_for(chrono::milliseconds(500));
+            waitForEvent(steady_clock::duration::zero());
         }
     }
 
     void playbackThreadFunc()
     {
-        deque<list<shared_ptr<Track>>> queued;
-        stack<shared_ptr<Track>>       done;
+        PlaybackQueue queue;
 
-        stack< tuple<
-            deque<list<shared_ptr<Track>>>, // queued + currentList 0
-            stack<shared_ptr<Track>>        // done                 1 
-                >> suspended;
+        // the next track is attached to the output while the current one plays,
+        // so that concat can switch to it without a gap
+        shared_ptr<Track> prerolledTrack;
+        data::OpenedTrack prerolled;
 
-        while (true)
+        auto preroll = [&]()
         {
-            list<shared_ptr<Track>> currentList;
-            if (!queued.empty())
+            auto upcoming = queue.upcoming(1);
+            if (upcoming.empty() || upcoming.front() == prerolledTrack)
             {
-                currentList = move(queued.front());
-                queued.pop_front();
+                return;
             }
-            else if (!suspended.empty())
-            {
-                queued = move(get<0>(suspended.top()));
-                done.swap(get<1>(suspended.top()));
-                suspended.pop();
 
-                currentList = move(queued.front());
-                queued.pop_front();
+            // concat holds it back until the current track is over,
+            // with crossfade this only happens when the overlap starts
+            prerolled = upcoming.front()->open();
+            pcmcache::record(prerolled);
+            if (output::attach(prerolled))
+            {
+                prerolledTrack = upcoming.front();
             }
             else
             {
-                unique_ptr<CommandPLAY> commandPlay = playbackThreadWait();
-                if (!commandPlay)
+                prerolled.markAsInvalid();
+                prerolledTrack.reset();
+            }
+        };
+
+        // prerolledTrack stays set so that it is not tried again while the current
+        // track plays, it is opened on its own once it is its turn
+        auto dropFailed = [&]()
+        {
+            if (prerolled.isValid() && output::failed(prerolled))
+            {
+                log(LT::warning, "Dropping %s, it failed before it started") % prerolled.filepath;
+                prerolled.markAsInvalid();
+            }
+        };
+
+        while (true)
+        {
+            if (queue.empty())
+            {
+                prerolled.markAsInvalid();
+                prerolledTrack.reset();
+                publishQueue(queue);
+
+                Command commandPlay;
+                if (!playbackThreadWait(commandPlay))
                 {
                     break;
                 }
-                else
-                {
-                    currentList = move(commandPlay->tracks);
-                }
+                // played tracks are kept, so previous still works
+                queue.append(move(commandPlay.tracks), orderOf(commandPlay.options));
             }
 
-            shared_ptr<Track> currentTrack;
+            shared_ptr<Track> currentTrack = queue.current();
             data::OpenedTrack opened;
-            while (!currentList.empty() || opened.isValid())
-            {
-                if (!opened.isValid())
-                {
-                    currentTrack = currentList.front();
-                    currentList.pop_front();
 
-                    opened = currentTrack->open();
+            if (currentTrack == prerolledTrack && prerolled.isValid())
+            {
+                opened = move(prerolled);
+            }
+            else
+            {
+                prerolled.markAsInvalid();
 
-                    if (!opened.isValid())
-                    {
-                        log(LT::error, "Could not open track %s") % currentTrack->name;
-                        continue;
-                    }
+                output::markSwitch();
+                opened = currentTrack->open();
+                pcmcache::record(opened);
+                output::reset();
+                if (!output::attach(opened))
+                {
+                    opened.markAsInvalid();
                 }
+            }
+            prerolledTrack.reset();
 
+            if (!opened.isValid())
+            {
+                log(LT::error, "Could not open track %s") % currentTrack->name;
+                queue.advance();
+                continue;
+            }
+            pcmcache::started(opened);
+
+            // commands that only add tracks keep the current one playing
+            while (opened.isValid())
+            {
                 NowPlaying::track = currentTrack;
                 NowPlaying::playing = true;
                 playbackPause = false;
-                unique_ptr<Command> command = playTrack(opened);
+                queueLength = queue.remaining();
+                queueIndex = queue.currentIndex();
+                publishNowPlaying();
+                publishQueue(queue);
+                prefetchUpcoming(queue);
+                Command command = playTrack(opened, preroll, dropFailed);
+
+                float fractionPlayed = 1;
+                if (command.type != CommandType::none && NowPlaying::duration > 0)
+                {
+                    fractionPlayed = static_cast<float>(NowPlaying::current) / NowPlaying::duration;
+                }
                 NowPlaying::reset();
-                if (!command)
+                publishNowPlaying();
+
+                if (command.type == CommandType::none)
                 {
-                    done.push(currentTrack);
+                    history::record(currentTrack, fractionPlayed);
+                    queue.advance();
+                    break;
                 }
-                else
+
+                switch (command.type)
                 {
-                    switch (command->type())
-                    {
-                        case CommandType::stopAll:
-                            opened.markAsInvalid();
-                            currentList.clear();
-                            queued.clear();
-                            while (!suspended.empty())
-                            {
-                                suspended.pop();
-                            }
-                            while (!done.empty())
-                            {
-                                done.pop();
-                            }
-                            break;
+                    case CommandType::stopAll:
+                        interrupt(opened);
+                        queue.clear();
+                        break;
 
-                        case CommandType::stop:
-                            opened.markAsInvalid();
-                            currentList.clear();
-                            queued.clear();
-                            while (!done.empty())
-                            {
-                                done.pop();
-                            }
+                    case CommandType::stop:
+                        interrupt(opened);
+                        queue.stop();
+                        break;
 
-                            if (!suspended.empty())
-                            {
-                                queued = move(get<0>(suspended.top()));
-                                done   = move(get<1>(suspended.top()));
-                                suspended.pop();
-                            }
-                            break;
+                    case CommandType::exit:
+                        history::record(currentTrack, fractionPlayed);
+                        goto end;
 
-                        case CommandType::exit:
-                            goto end;
+                    case CommandType::next:
+                        // skipped tracks are never opened
+                        interrupt(opened);
+                        queue.advance(command.count);
+                        break;
 
-                        case CommandType::next:
-                            opened.markAsInvalid();
-                            done.push(currentTrack);
-                            if (currentList.empty())
-                            {
-                                if (!queued.empty())
-                                {
-                                    currentList = move(queued.front());
-                                    queued.pop_front();
-                                }
-                                if (!suspended.empty())
-                                {
-                                    queued = move(get<0>(suspended.top()));
-                                    done   = move(get<1>(suspended.top()));
-                                    suspended.pop();
-                                }
-                            }
-                            break;
+                    case CommandType::previous:
+                        interrupt(opened);
+                        queue.back(command.count);
+                        break;
 
-                        case CommandType::previous:
+                    case CommandType::jump:
+                        interrupt(opened);
+                        queue.jump(command.index);
+                        break;
+
+                    case CommandType::seek:
+                        // only the beginning was cached, playTrack seeks once it is prerolled
+                        interrupt(opened);
+                        opened = currentTrack->open(data::OpenedTrack::Source::file);
+                        if (output::attach(opened))
+                        {
+                            Gst::State state, pending;
+                            output::pause();
+                            opened.bin->get_state(state, pending, Gst::ClockTime(2 * Gst::SECOND));
+                            pendingCommands.push_front(move(command));
+                        }
+                        else
+                        {
                             opened.markAsInvalid();
-                            currentList.push_front(currentTrack);
-                            if (!done.empty())
-                            {
-                                currentList.push_front(done.top());
-                                done.pop();
-                            }
-                            break;
+                        }
+                        break;
 
-                        case CommandType::play:
-                            {
-                                unique_ptr<CommandPLAY> commandPlay = unique_ptr<CommandPLAY>(dynamic_cast<CommandPLAY*>(command.release()));
-                                if (commandPlay->options & PlaybackOption::stopCurrentPlayback)
-                                {
-                                    opened.markAsInvalid();
-                                    currentList.clear();
-                                    queued.clear();
-                                    while (!done.empty())
-                                    {
-                                        done.pop();
-                                    }
-                                    while (!suspended.empty())
-                                    {
-                                        suspended.pop();
-                                    }
-
-                                    currentList = move(commandPlay->tracks);
-                                }
-                                else if (commandPlay->options & PlaybackOption::suspendCurrentPlayback)
-                                {
-                                    opened.markAsInvalid();
-                                    currentList.push_front(currentTrack);
-                                    queued.push_front(move(currentList));
-
-                                    suspended.emplace(move(queued), move(done));
-
-                                    decltype(done) temp{};
-                                    done.swap(temp); // make it valid after move
-
-                                    currentList = move(commandPlay->tracks);
-                                }
-                                else if (commandPlay->options & PlaybackOption::playAfterCurrentList)
-                                {
-                                    queued.push_front(move(commandPlay->tracks));
-                                }
-                                else if (commandPlay->options & PlaybackOption::playAfterCurrentTrack)
-                                {
-                                    currentList.splice(currentList.begin(), commandPlay->tracks, commandPlay->tracks.begin(), commandPlay->tracks.end());
-                                }
-                                else if (commandPlay->options & PlaybackOption::playAfterEverything)
-                                {
-                                    queued.push_back(move(commandPlay->tracks));
-                                }
-                                else
-                                {
-                                    log(LT::error, "No playback option");
-                                }
-                            }
-                            break;
+                    case CommandType::play:
+                        if (command.options & PlaybackOption::stopCurrentPlayback)
+                        {
+                            interrupt(opened);
+                            queue.replace(move(command.tracks), orderOf(command.options));
+                        }
+                        else if (command.options & PlaybackOption::suspendCurrentPlayback)
+                        {
+                            // the interrupted track starts over once this is done
+                            interrupt(opened);
+                            queue.suspend(move(command.tracks), orderOf(command.options));
+                        }
+                        else if (command.options & PlaybackOption::playAfterCurrentList)
+                        {
+                            queue.insertAfterCurrentList(move(command.tracks), orderOf(command.options));
+                        }
+                        else if (command.options & PlaybackOption::playAfterCurrentTrack)
+                        {
+                            queue.insertAfterCurrent(move(command.tracks), orderOf(command.options));
+                        }
+                        else if (command.options & PlaybackOption::playAfterEverything)
+                        {
+                            queue.append(move(command.tracks), orderOf(command.options));
+                        }
+                        else
+                        {
+                            log(LT::error, "No playback option");
+                        }
+                        break;
 
-                        default:
-                            log(LT::error, "Playback thread received invalid command");
-                            break;
-                    }
+                    default:
+                        log(LT::error, "Playback thread received invalid command");
+                        break;
+                }
+
+                if (!opened.isValid())
+                {
+                    history::record(currentTrack, fractionPlayed);
                 }
             }
         }
-end:;
+end:
+        atomic_store(&queueSnapshot, shared_ptr<const PlaybackQueue::Snapshot>(make_shared<PlaybackQueue::Snapshot>()));
     }
 
-    unique_ptr<Command> getPlaybackCommand()
+    bool getPlaybackCommand(Command& command)
     {
-        if (!playbackControl.empty())
+        Command received;
+        while (playbackControl.pop(received))
         {
-            playbackControlMutex.lock();
+            pendingCommands.push_back(move(received));
+        }
 
-            auto ret = move(playbackControl.front());
-            playbackControl.pop();
+        while (!pendingCommands.empty())
+        {
+            command = move(pendingCommands.front());
+            pendingCommands.pop_front();
 
-            playbackControlMutex.unlock();
-            return ret;
+            if (isSkip(command.type))
+            {
+                // next and previous do not cancel out: both are clamped
+                // to the ends of the queue, and next past the end stops
+                while (!pendingCommands.empty() && pendingCommands.front().type == command.type)
+                {
+                    command.count += pendingCommands.front().count;
+                    pendingCommands.pop_front();
+                }
+            }
+            else if (command.type == CommandType::seek)
+            {
+                // an absolute seek makes everything before it irrelevant
+                while (!pendingCommands.empty() && pendingCommands.front().type == CommandType::seek)
+                {
+                    Command& following = pendingCommands.front();
+                    if (following.seekRelative)
+                    {
+                        command.seekTo += following.seekTo;
+                    }
+                    else
+                    {
+                        command.seekTo = following.seekTo;
+                        command.seekRelative = false;
+                    }
+                    command.seekAccurate = command.seekAccurate || following.seekAccurate;
+                    pendingCommands.pop_front();
+                }
+            }
+            else if (command.type == CommandType::play)
+            {
+                if (!pendingCommands.empty() && pendingCommands.front().type == CommandType::play &&
+                        (pendingCommands.front().options & PlaybackOption::stopCurrentPlayback))
+                {
+                    continue;
+                }
+
+                // an artist or album without tracks is nothing to play
+                bool listed = command.artist || command.album;
+                if (command.artist)
+                {
+                    command.tracks.splice(command.tracks.end(), command.artist->getTracks());
+                    command.artist.reset();
+                }
+                if (command.album)
+                {
+                    command.tracks.splice(command.tracks.end(), command.album->getTracks());
+                    command.album.reset();
+                }
+                if (listed && command.tracks.empty())
+                {
+                    continue;
+                }
+            }
+            else if (isPauseChange(command.type))
+            {
+                // pause and resume set the state, toggles after them flip it
+                CommandType absolute = CommandType::none;
+                bool flip = false;
+                while (true)
+                {
+                    if (command.type == CommandType::toggle)
+                    {
+                        flip = !flip;
+                    }
+                    else
+                    {
+                        absolute = command.type;
+                        flip = false;
+                    }
+
+                    if (pendingCommands.empty() || !isPauseChange(pendingCommands.front().type))
+                    {
+                        break;
+                    }
+                    command = move(pendingCommands.front());
+                    pendingCommands.pop_front();
+                }
+
+                if (absolute == CommandType::none)
+                {
+                    if (!flip)
+                    {
+                        continue;
+                    }
+                    command.type = CommandType::toggle;
+                }
+                else if (flip)
+                {
+                    command.type = absolute == CommandType::pause ? CommandType::resume : CommandType::pause;
+                }
+                else
+                {
+                    command.type = absolute;
+                }
+            }
+
+            return true;
         }
-        else
+
+        return false;
+    }
+
+    void sendPlaybackCommand(Command command)
+    {
+        while (!playbackControl.push(move(command)))
         {
-            return {};
+            // only happens if the playback thread is stuck for a while,
+            // losing commands (EXIT in particular) would be worse than waiting
+            wakePlaybackThread();
+            this_thread::yield();
         }
+
+        wakePlaybackThread();
     }
 
-    void sendPlaybackCommand(Command* command)
+    void wakePlaybackThread()
     {
-        playbackControlMutex.lock();
-        playbackControl.emplace(command);
-        playbackControlMutex.unlock();
+        {
+            lock_guard<mutex> lock(wakeupMutex);
+            wakeupPending = true;
+        }
+        wakeupCondition.notify_one();
     }
 
     bool playbackInProcess()
     {
-        return NowPlaying::playing;
+        return nowPlaying().state != PlaybackState::stopped;
     }
 
+    NowPlayingSnapshot nowPlaying()
+    {
+        return nowPlayingSnapshot.load();
+    }
 
-    Command::Command(CommandType commandType) :
-        commandType(commandType) {};
+    shared_ptr<const PlaybackQueue::Snapshot> queue()
+    {
+        return atomic_load(&queueSnapshot);
+    }
 
-    Command::~Command() {};
 
-    CommandType Command::type() const
+    Command Command::play(list<shared_ptr<Track>> tracks, PlaybackOptions options)
     {
-        return commandType;
+        Command ret(CommandType::play);
+        ret.tracks = move(tracks);
+        ret.options = options;
+        return ret;
     }
 
 
-    CommandPLAY::CommandPLAY(const list<shared_ptr<Track>>& tracks, PlaybackOptions options) :
-        Command(CommandType::play),
-        tracks(tracks.begin(), tracks.end()),
-        options(options) {};
-
+    Command Command::jump(size_t index)
+    {
+        Command ret(CommandType::jump);
+        ret.index = index;
+        return ret;
+    }
 
-    void NowPlaying::reset()
+    Command Command::seek(gint64 position, bool relative, bool accurate)
     {
-        track.reset();
-        duration = 0;
-        current = 0;
+        Command ret(CommandType::seek);
+        ret.seekTo = position;
+        ret.seekRelative = relative;
+        ret.seekAccurate = accurate;
+        return ret;
     }
+
+
 }
@@ -0,0 +1,336 @@
+#include "play_stats.hpp"
+#include "output.hpp"
+#include "log.hpp"
+
+#include <list>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+
+#include <boost/format.hpp>
+
+using namespace std;
+using namespace chrono;
+
+using boost::format;
+
+namespace playstats
+{
+    namespace
+    {
+        // detached tracks kept for recent()
+        const size_t recentLimit = 32;
+
+        steady_clock::duration dumpInterval = seconds(60);
+
+        struct Recording
+        {
+            // tells recordings apart in the streaming threads,
+            // where an address could belong to a new one
+            uint64_t serial = 0;
+            // only compared with message sources, never dereferenced
+            GstObject* bin = nullptr;
+
+            uint64_t trackId = 0;
+            string   filepath;
+            int64_t  attachedAt = 0;
+
+            atomic<gint64>   toPaused{ -1 };
+            atomic<gint64>   toPlaying{ -1 };
+            atomic<gint64>   firstBuffer{ -1 };
+            atomic<uint64_t> qosMessages{ 0 };
+            atomic<uint64_t> errors{ 0 };
+            atomic<uint64_t> warnings{ 0 };
+            atomic<gint64>   decoderCpu{ 0 };
+
+            // underruns from the times it was current before
+            uint64_t underruns = 0;
+            // output underruns when it became current
+            uint64_t underrunBase = 0;
+        };
+
+        // changed by the playback thread, read from anywhere
+        mutex                       recordingsMutex;
+        list<shared_ptr<Recording>> attachedTracks;
+        shared_ptr<Recording>       currentRecording;
+        deque<TrackStats>           finished;
+
+        uint64_t                    serials = 0;
+        steady_clock::time_point    lastDump;
+
+        // the CPU clock of a streaming thread when it pushed its last buffer, and for which track
+        thread_local uint64_t threadSerial = 0;
+        thread_local int64_t  threadCpu = 0;
+
+        int64_t nowNs()
+        {
+            return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+        }
+
+        int64_t threadCpuNs()
+        {
+            timespec ts;
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+            return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+        }
+
+        uint64_t outputUnderruns()
+        {
+            return output::underruns();
+        }
+
+        // recordingsMutex has to be held by everything below
+
+        shared_ptr<Recording> find(const data::OpenedTrack& track)
+        {
+            GstObject* bin = GST_OBJECT(track.bin->gobj());
+            for (auto& recording : attachedTracks)
+            {
+                if (recording->bin == bin)
+                {
+                    return recording;
+                }
+            }
+            return {};
+        }
+
+        // the track the source belongs to, or the current one for the rest of the output
+        shared_ptr<Recording> owner(GstObject* source)
+        {
+            for (auto& recording : attachedTracks)
+            {
+                if (source == recording->bin || gst_object_has_as_ancestor(source, recording->bin))
+                {
+                    return recording;
+                }
+            }
+            return currentRecording;
+        }
+
+        void leaveCurrent()
+        {
+            if (currentRecording)
+            {
+                currentRecording->underruns += outputUnderruns() - currentRecording->underrunBase;
+                currentRecording.reset();
+            }
+        }
+
+        TrackStats snapshot(const Recording& recording)
+        {
+            TrackStats ret;
+            ret.trackId     = recording.trackId;
+            ret.filepath    = recording.filepath;
+            ret.toPaused    = recording.toPaused;
+            ret.toPlaying   = recording.toPlaying;
+            ret.firstBuffer = recording.firstBuffer;
+            ret.underruns   = recording.underruns;
+            ret.qosMessages = recording.qosMessages;
+            ret.errors      = recording.errors;
+            ret.warnings    = recording.warnings;
+            ret.decoderCpu  = recording.decoderCpu;
+
+            if (&recording == currentRecording.get())
+            {
+                ret.underruns += outputUnderruns() - recording.underrunBase;
+            }
+            return ret;
+        }
+
+        string showTime(gint64 time)
+        {
+            return time < 0 ? string("never") : (format("%.1f ms") % (time / 1e6)).str();
+        }
+
+        void logStats(const char* what, const TrackStats& stats)
+        {
+            log(LT::info, "%s %s: PAUSED after %s, PLAYING after %s, first buffer after %s, "
+                    "%u underruns, %u QoS, %u errors, %u warnings, %.1f ms of decoder CPU")
+                % what % stats.filepath
+                % showTime(stats.toPaused) % showTime(stats.toPlaying) % showTime(stats.firstBuffer)
+                % stats.underruns % stats.qosMessages % stats.errors % stats.warnings
+                % (stats.decoderCpu / 1e6);
+        }
+    }
+
+    void init()
+    {
+        if (const char* value = getenv("PLAYER_STATS_INTERVAL"))
+        {
+            dumpInterval = seconds(max(atoi(value), 0));
+        }
+    }
+
+    void attached(data::OpenedTrack& track)
+    {
+        auto recording = make_shared<Recording>();
+        recording->bin        = GST_OBJECT(track.bin->gobj());
+        recording->trackId    = track.parent ? track.parent->id : 0;
+        recording->filepath   = track.filepath;
+        recording->attachedAt = nowNs();
+
+        {
+            lock_guard<mutex> lock(recordingsMutex);
+            recording->serial = ++serials;
+            attachedTracks.push_back(recording);
+        }
+
+        // the CPU a thread used between two of its buffers went into the later one,
+        // what it did before its first buffer of the track is not known
+        track.pad->add_probe(Gst::PAD_PROBE_TYPE_BUFFER,
+                [recording](const Glib::RefPtr<Gst::Pad>&, const Gst::PadProbeInfo&)
+        {
+            int64_t cpu = threadCpuNs();
+            if (threadSerial == recording->serial)
+            {
+                recording->decoderCpu += cpu - threadCpu;
+            }
+            threadSerial = recording->serial;
+            threadCpu = cpu;
+
+            if (recording->firstBuffer < 0)
+            {
+                gint64 none = -1;
+                recording->firstBuffer.compare_exchange_strong(none, nowNs() - recording->attachedAt);
+            }
+            return Gst::PAD_PROBE_OK;
+        });
+    }
+
+    void detached(data::OpenedTrack& track)
+    {
+        TrackStats stats;
+        {
+            lock_guard<mutex> lock(recordingsMutex);
+            auto recording = find(track);
+            if (!recording)
+            {
+                return;
+            }
+            if (recording == currentRecording)
+            {
+                leaveCurrent();
+            }
+            attachedTracks.remove(recording);
+
+            stats = snapshot(*recording);
+            finished.push_back(stats);
+            if (finished.size() > recentLimit)
+            {
+                finished.pop_front();
+            }
+        }
+        logStats("Played", stats);
+    }
+
+    void message(const Glib::RefPtr<Gst::Message>& message)
+    {
+        auto type = message->get_message_type();
+        if (type != Gst::MESSAGE_STATE_CHANGED && type != Gst::MESSAGE_QOS &&
+                type != Gst::MESSAGE_ERROR && type != Gst::MESSAGE_WARNING)
+        {
+            return;
+        }
+        GstObject* source = message->get_source()->gobj();
+
+        lock_guard<mutex> lock(recordingsMutex);
+        if (type == Gst::MESSAGE_STATE_CHANGED)
+        {
+            // only the bin itself, its elements get there one by one before it does
+            for (auto& recording : attachedTracks)
+            {
+                if (recording->bin != source)
+                {
+                    continue;
+                }
+
+                Gst::State oldState, newState, pending;
+                Glib::RefPtr<Gst::MessageStateChanged>::cast_static(message)->parse(oldState, newState, pending);
+                auto& time = newState == Gst::STATE_PAUSED ? recording->toPaused : recording->toPlaying;
+                if ((newState == Gst::STATE_PAUSED || newState == Gst::STATE_PLAYING) && time < 0)
+                {
+                    time = nowNs() - recording->attachedAt;
+                }
+            }
+            return;
+        }
+
+        auto recording = owner(source);
+        if (!recording)
+        {
+            return;
+        }
+        switch (type)
+        {
+            case Gst::MESSAGE_QOS:
+                recording->qosMessages++;
+                break;
+            case Gst::MESSAGE_ERROR:
+                recording->errors++;
+                break;
+            default:
+                recording->warnings++;
+                break;
+        }
+    }
+
+    void current(const data::OpenedTrack& track)
+    {
+        lock_guard<mutex> lock(recordingsMutex);
+        auto recording = find(track);
+        if (recording == currentRecording)
+        {
+            return;
+        }
+
+        leaveCurrent();
+        if (recording)
+        {
+            recording->underrunBase = outputUnderruns();
+            currentRecording = recording;
+            lastDump = steady_clock::now();
+        }
+    }
+
+    void tick()
+    {
+        if (dumpInterval == steady_clock::duration::zero())
+        {
+            return;
+        }
+
+        TrackStats stats;
+        {
+            lock_guard<mutex> lock(recordingsMutex);
+            auto now = steady_clock::now();
+            if (!currentRecording || now - lastDump < dumpInterval)
+            {
+                return;
+            }
+            lastDump = now;
+            stats = snapshot(*currentRecording);
+        }
+        logStats("Playing", stats);
+    }
+
+    bool currentStats(TrackStats& stats)
+    {
+        lock_guard<mutex> lock(recordingsMutex);
+        if (!currentRecording)
+        {
+            return false;
+        }
+        stats = snapshot(*currentRecording);
+        return true;
+    }
+
+    vector<TrackStats> recent()
+    {
+        lock_guard<mutex> lock(recordingsMutex);
+        return vector<TrackStats>(finished.begin(), finished.end());
+    }
+}
@@ -0,0 +1,449 @@
+#include "playback_queue.hpp"
+
+#include <algorithm>
+#include <utility>
+
+using namespace std;
+
+using data::Track;
+
+PlaybackQueue::PlaybackQueue() :
+    random(random_device{}())
+{
+    frames.emplace_back();
+}
+
+bool PlaybackQueue::empty() const
+{
+    return top().current >= top().tracks.size();
+}
+
+shared_ptr<Track> PlaybackQueue::current() const
+{
+    if (empty())
+    {
+        return nullptr;
+    }
+    return trackAt(top().current);
+}
+
+size_t PlaybackQueue::currentIndex() const
+{
+    return top().current;
+}
+
+size_t PlaybackQueue::size() const
+{
+    return top().tracks.size();
+}
+
+const shared_ptr<Track>& PlaybackQueue::at(size_t index) const
+{
+    return top().tracks.at(storageIndex(index));
+}
+
+size_t PlaybackQueue::remaining() const
+{
+    return empty() ? 0 : size() - top().current - 1;
+}
+
+vector<shared_ptr<Track>> PlaybackQueue::upcoming(size_t count) const
+{
+    vector<shared_ptr<Track>> ret;
+    const Frame& frame = top();
+    for (size_t index = frame.current + 1; index < frame.tracks.size() && ret.size() < count; index++)
+    {
+        ret.push_back(trackAt(index));
+    }
+    return ret;
+}
+
+void PlaybackQueue::advance(size_t count)
+{
+    top().current = min(top().current + count, size());
+    dropFinishedFrames();
+    trimPlayed();
+    spreadArtists();
+}
+
+void PlaybackQueue::back(size_t count)
+{
+    top().current -= min(count, top().current);
+}
+
+void PlaybackQueue::jump(size_t index)
+{
+    top().current = min(index, size());
+    dropFinishedFrames();
+    trimPlayed();
+    spreadArtists();
+}
+
+void PlaybackQueue::replace(TrackList tracks, Order order)
+{
+    frames.clear();
+    frames.emplace_back();
+    append(move(tracks), order);
+}
+
+void PlaybackQueue::suspend(TrackList tracks, Order order)
+{
+    if (!empty())
+    {
+        frames.emplace_back();
+    }
+    append(move(tracks), order);
+}
+
+void PlaybackQueue::insertAfterCurrent(TrackList tracks, Order order)
+{
+    if (empty())
+    {
+        append(move(tracks), order);
+        return;
+    }
+
+    // the tracks become part of the current list, which can not stay lazily
+    // shuffled with tracks in the middle of it, so they are shuffled right away
+    size_t list = listOf(top().current);
+    materialize(list);
+
+    size_t count = tracks.size();
+    Tracks inserted = makeTracks(move(tracks));
+    if (order != Order::asGiven)
+    {
+        Shuffle shuffle(count, random());
+        Tracks shuffled;
+        for (size_t index = 0; index < count; index++)
+        {
+            shuffled.pushBack(Tracks::value(inserted.handleAt(shuffle[index])));
+        }
+        inserted = move(shuffled);
+    }
+
+    top().lists[list].size += count;
+    insertTracks(top().current + 1, move(inserted));
+    spreadArtists();
+}
+
+void PlaybackQueue::insertAfterCurrentList(TrackList tracks, Order order)
+{
+    if (empty())
+    {
+        append(move(tracks), order);
+        return;
+    }
+
+    size_t list = listOf(top().current);
+    size_t index = listEnd(list);
+    top().lists.insert(top().lists.begin() + list + 1, makeList(tracks.size(), order));
+    insertTracks(index, makeTracks(move(tracks)));
+    spreadArtists();
+}
+
+void PlaybackQueue::append(TrackList tracks, Order order)
+{
+    if (tracks.empty())
+    {
+        return;
+    }
+
+    top().lists.push_back(makeList(tracks.size(), order));
+    insertTracks(size(), makeTracks(move(tracks)));
+    spreadArtists();
+}
+
+void PlaybackQueue::insert(size_t index, shared_ptr<Track> track)
+{
+    if (top().lists.empty())
+    {
+        top().lists.push_back(makeList(1, Order::asGiven));
+    }
+    else
+    {
+        size_t list = index == 0 ? 0 : listOf(index - 1);
+        materialize(list);
+        top().lists[list].size++;
+    }
+
+    Tracks inserted;
+    inserted.pushBack(move(track));
+    insertTracks(index, move(inserted));
+}
+
+void PlaybackQueue::remove(size_t index)
+{
+    Frame& frame = top();
+
+    size_t list = listOf(index);
+    materialize(list);
+    if (--frame.lists[list].size == 0)
+    {
+        frame.lists.erase(frame.lists.begin() + list);
+    }
+
+    frame.tracks.eraseAt(index);
+    if (index < frame.current)
+    {
+        frame.current--;
+    }
+
+    dropFinishedFrames();
+    changes++;
+}
+
+void PlaybackQueue::stop()
+{
+    frames.pop_back();
+    if (frames.empty())
+    {
+        frames.emplace_back();
+    }
+    dropFinishedFrames();
+    changes++;
+}
+
+void PlaybackQueue::clear()
+{
+    frames.clear();
+    frames.emplace_back();
+    changes++;
+}
+
+uint64_t PlaybackQueue::version() const
+{
+    return changes;
+}
+
+PlaybackQueue::Snapshot PlaybackQueue::snapshot() const
+{
+    Snapshot ret;
+    ret.tracks.reserve(size());
+
+    // at() would look up the list of every track, going list by list is linear
+    const Frame& frame = top();
+    size_t start = 0;
+    for (auto &list : frame.lists)
+    {
+        for (size_t offset = 0; offset < list.size; offset++)
+        {
+            size_t stored = offset;
+            if (list.shuffled)
+            {
+                auto iter = list.swapped.find(offset);
+                stored = iter != list.swapped.end() ? iter->second : list.order[offset];
+            }
+            ret.tracks.push_back(frame.tracks.at(start + stored).get());
+        }
+        start += list.size;
+    }
+
+    ret.suspended = frames.size() - 1;
+    return ret;
+}
+
+PlaybackQueue::Frame& PlaybackQueue::top()
+{
+    return frames.back();
+}
+
+const PlaybackQueue::Frame& PlaybackQueue::top() const
+{
+    return frames.back();
+}
+
+size_t PlaybackQueue::listOf(size_t index) const
+{
+    // there are only as many lists as times something was enqueued,
+    // so walking them is cheap compared to the tracks themselves
+    const auto& lists = top().lists;
+    size_t end = 0;
+    for (size_t list = 0; list < lists.size(); list++)
+    {
+        end += lists[list].size;
+        if (index < end)
+        {
+            return list;
+        }
+    }
+    return lists.empty() ? 0 : lists.size() - 1;
+}
+
+size_t PlaybackQueue::listStart(size_t list) const
+{
+    const auto& lists = top().lists;
+    size_t start = 0;
+    for (size_t i = 0; i < list && i < lists.size(); i++)
+    {
+        start += lists[i].size;
+    }
+    return start;
+}
+
+size_t PlaybackQueue::listEnd(size_t list) const
+{
+    return listStart(list) + (list < top().lists.size() ? top().lists[list].size : 0);
+}
+
+size_t PlaybackQueue::storageIndex(size_t index) const
+{
+    if (top().lists.empty())
+    {
+        return index;
+    }
+
+    size_t list = listOf(index);
+    const List& info = top().lists[list];
+    if (!info.shuffled)
+    {
+        return index;
+    }
+
+    size_t start = listStart(list);
+    size_t offset = index - start;
+    auto iter = info.swapped.find(offset);
+    return start + (iter != info.swapped.end() ? iter->second : info.order[offset]);
+}
+
+const shared_ptr<Track>& PlaybackQueue::trackAt(size_t index) const
+{
+    return Tracks::value(top().tracks.handleAt(storageIndex(index)));
+}
+
+PlaybackQueue::List PlaybackQueue::makeList(size_t size, Order order)
+{
+    List list;
+    list.size = size;
+    if (order != Order::asGiven)
+    {
+        list.shuffled = true;
+        list.spreadArtists = order == Order::shuffledSpreadArtists;
+        list.order = Shuffle(size, random());
+    }
+    return list;
+}
+
+PlaybackQueue::Tracks PlaybackQueue::makeTracks(TrackList tracks)
+{
+    Tracks ret;
+    for (auto &track : tracks)
+    {
+        ret.pushBack(move(track));
+    }
+    return ret;
+}
+
+void PlaybackQueue::insertTracks(size_t index, Tracks tracks)
+{
+    Frame& frame = top();
+
+    // a frame that has run out plays whatever is added to its end
+    bool finished = frame.current >= frame.tracks.size();
+
+    size_t count = tracks.size();
+    frame.tracks.splice(index, move(tracks));
+
+    if (index < frame.current || (index == frame.current && !finished))
+    {
+        frame.current += count;
+    }
+    changes++;
+}
+
+void PlaybackQueue::materialize(size_t list)
+{
+    Frame& frame = top();
+    if (list >= frame.lists.size() || !frame.lists[list].shuffled)
+    {
+        return;
+    }
+
+    List& info = frame.lists[list];
+    size_t start = listStart(list);
+
+    Tracks front = frame.tracks.splitFront(start);
+    Tracks stored = frame.tracks.splitFront(info.size);
+
+    Tracks ordered;
+    for (size_t offset = 0; offset < info.size; offset++)
+    {
+        auto iter = info.swapped.find(offset);
+        size_t index = iter != info.swapped.end() ? iter->second : info.order[offset];
+        ordered.pushBack(Tracks::value(stored.handleAt(index)));
+    }
+
+    frame.tracks.splice(0, move(ordered));
+    frame.tracks.splice(0, move(front));
+
+    info.shuffled = false;
+    info.spreadArtists = false;
+    info.swapped.clear();
+}
+
+void PlaybackQueue::spreadArtists()
+{
+    Frame& frame = top();
+    size_t next = frame.current + 1;
+    if (next >= frame.tracks.size())
+    {
+        return;
+    }
+
+    size_t list = listOf(next);
+    List& info = frame.lists[list];
+    if (!info.shuffled || !info.spreadArtists)
+    {
+        return;
+    }
+
+    const string& artist = trackAt(frame.current)->artistName;
+    if (trackAt(next)->artistName != artist)
+    {
+        return;
+    }
+
+    size_t start = listStart(list);
+    size_t end = min(start + info.size, next + 1 + spreadDistance);
+    for (size_t candidate = next + 1; candidate < end; candidate++)
+    {
+        if (trackAt(candidate)->artistName != artist)
+        {
+            size_t nextStored = storageIndex(next) - start;
+            size_t candidateStored = storageIndex(candidate) - start;
+            info.swapped[next - start] = candidateStored;
+            info.swapped[candidate - start] = nextStored;
+            changes++;
+            return;
+        }
+    }
+}
+
+void PlaybackQueue::dropFinishedFrames()
+{
+    while (frames.size() > 1 && empty())
+    {
+        frames.pop_back();
+        changes++;
+    }
+}
+
+void PlaybackQueue::trimPlayed()
+{
+    Frame& frame = top();
+    size_t dropped = 0;
+    size_t lists = 0;
+    while (lists < frame.lists.size() && frame.current - dropped >= frame.lists[lists].size + playedLimit)
+    {
+        dropped += frame.lists[lists].size;
+        lists++;
+    }
+    if (lists == 0)
+    {
+        return;
+    }
+
+    frame.tracks.splitFront(dropped);
+    frame.lists.erase(frame.lists.begin(), frame.lists.begin() + lists);
+    frame.current -= dropped;
+    changes++;
+}
@@ -1,8 +1,11 @@
 #include "playlist.hpp"
+#include "workers.hpp"
+#include "history.hpp"
 
 #include <iostream>
 #include <utility>
 #include <algorithm>
+#include <mutex>
 
 using namespace std;
 
@@ -19,26 +22,113 @@ Playlist::Playlist(const string& name) : name(name) {}
 SimplePlaylist::SimplePlaylist(const string& name) : Playlist(name) {}
 
 SimplePlaylist::SimplePlaylist(const string& name, const list<shared_ptr<Track>>& tracks) :
-    Playlist(name), tracks(tracks) 
-{}
+    Playlist(name)
+{
+    for (auto &track : tracks)
+    {
+        addTrack(track);
+    }
+}
 
 void SimplePlaylist::addTrack(shared_ptr<Track> track)
 {
-    tracks.push_back(track);
+    insertTrack(tracks.size(), move(track));
+}
+
+void SimplePlaylist::insertTrack(size_t pos, shared_ptr<Track> track)
+{
+    const Track* key = track.get();
+    entries[key].push_back(tracks.insert(pos, move(track)));
 }
 
 void SimplePlaylist::removeTrack(shared_ptr<Track> track)
 {
-    auto trackIter = find(tracks.begin(), tracks.end(), track);
-    if (trackIter != tracks.end())
+    auto entriesIter = entries.find(track.get());
+    if (entriesIter == entries.end())
+    {
+        return;
+    }
+
+    // a track is rarely added more than once, so this is O(log n) in practice
+    auto& handles = entriesIter->second;
+    auto first = min_element(handles.begin(), handles.end(), [this](Entries::Handle fst, Entries::Handle snd)
+    {
+        return tracks.position(fst) < tracks.position(snd);
+    });
+
+    tracks.erase(*first);
+    handles.erase(first);
+    if (handles.empty())
     {
-        tracks.erase(trackIter);
+        entries.erase(entriesIter);
     }
 }
 
+void SimplePlaylist::removeAt(size_t pos)
+{
+    if (pos >= tracks.size())
+    {
+        return;
+    }
+
+    auto handle = tracks.handleAt(pos);
+    auto entriesIter = entries.find(Entries::value(handle).get());
+    auto& handles = entriesIter->second;
+    handles.erase(find(handles.begin(), handles.end(), handle));
+    if (handles.empty())
+    {
+        entries.erase(entriesIter);
+    }
+
+    tracks.erase(handle);
+}
+
+void SimplePlaylist::moveTrack(size_t from, size_t to)
+{
+    if (from >= tracks.size() || to >= tracks.size())
+    {
+        return;
+    }
+
+    // handles stay valid, so the index does not change
+    tracks.move(from, to);
+}
+
+bool SimplePlaylist::contains(const shared_ptr<Track>& track) const
+{
+    return entries.count(track.get()) != 0;
+}
+
+vector<size_t> SimplePlaylist::positionsOf(const shared_ptr<Track>& track) const
+{
+    vector<size_t> ret;
+
+    auto entriesIter = entries.find(track.get());
+    if (entriesIter != entries.end())
+    {
+        for (auto handle : entriesIter->second)
+        {
+            ret.push_back(tracks.position(handle));
+        }
+        sort(ret.begin(), ret.end());
+    }
+
+    return ret;
+}
+
+size_t SimplePlaylist::size() const
+{
+    return tracks.size();
+}
+
+const shared_ptr<Track>& SimplePlaylist::trackAt(size_t pos) const
+{
+    return tracks.at(pos);
+}
+
 list<shared_ptr<Track>> SimplePlaylist::getTracks() const
 {
-    return tracks;
+    return { tracks.begin(), tracks.end() };
 }
 
 void SimplePlaylist::testPrint() const
@@ -54,20 +144,87 @@ void SimplePlaylist::testPrint() const
 
 
 // SMART PLAYLIST
+namespace
+{
+    // libraries smaller than this are not worth waking up the workers for
+    const size_t minParallelTracks = 4096;
+    const size_t chunkSize         = 1024;
+
+    mutex                  conditionPoolMutex;
+    size_t                 conditionThreads = 0;
+    shared_ptr<WorkerPool> conditionPool;
+
+    shared_ptr<WorkerPool> getConditionPool()
+    {
+        lock_guard<mutex> lock(conditionPoolMutex);
+        if (!conditionPool)
+        {
+            conditionPool = make_shared<WorkerPool>(conditionThreads);
+        }
+        return conditionPool;
+    }
+}
+
 SmartPlaylist::SmartPlaylist(const string& name, std::unique_ptr<Condition> condition) : 
     Playlist(name),
     condition(move(condition))
 {}
 
+void SmartPlaylist::setThreadCount(size_t count)
+{
+    lock_guard<mutex> lock(conditionPoolMutex);
+    if (count != conditionThreads)
+    {
+        conditionThreads = count;
+        conditionPool.reset();
+    }
+}
+
+size_t SmartPlaylist::getThreadCount()
+{
+    lock_guard<mutex> lock(conditionPoolMutex);
+    return conditionThreads == 0 ? WorkerPool::defaultThreadCount() : conditionThreads;
+}
+
 list<shared_ptr<Track>> SmartPlaylist::getTracks() const
 {
-    list<shared_ptr<Track>> ret;
+    const auto& library = data::allArtists->allAlbums->tracks;
 
-    for (auto &track : data::allArtists->getTracks())
+    vector<const shared_ptr<Track>*> tracks;
+    tracks.reserve(library.size());
+    for (auto &track : library)
     {
-        if(condition->check(track))
+        tracks.push_back(&track);
+    }
+
+    condition->startEvaluation();
+
+    // every chunk only writes its own part of matches,
+    // so merging them in order keeps the library order
+    vector<char> matches(tracks.size());
+    auto checkChunk = [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
         {
-            ret.push_back(track);
+            matches[i] = condition->check(*tracks[i]);
+        }
+    };
+
+    if (tracks.size() < minParallelTracks || getThreadCount() == 1)
+    {
+        checkChunk(0, tracks.size());
+    }
+    else
+    {
+        getConditionPool()->parallelFor(tracks.size(), chunkSize, checkChunk);
+    }
+
+    list<shared_ptr<Track>> ret;
+    for (size_t i = 0; i < tracks.size(); i++)
+    {
+        if (matches[i])
+        {
+            ret.push_back(*tracks[i]);
         }
     }
 
@@ -115,11 +272,61 @@ bool ArtistNameCondition::check(const shared_ptr<Track>& track) const
 }
 
 
+// PLAY COUNT
+PlayCountCondition::PlayCountCondition(Comparison comparison, unsigned count) :
+    comparison(comparison),
+    count(count)
+{}
+
+bool PlayCountCondition::check(const shared_ptr<Track>& track) const
+{
+    unsigned playCount = history::stats(track->id).playCount;
+    switch (comparison)
+    {
+        case Comparison::less:
+            return playCount < count;
+        case Comparison::equal:
+            return playCount == count;
+        case Comparison::greater:
+            return playCount > count;
+    }
+    return false;
+}
+
+
+// NOT PLAYED FOR
+NotPlayedForCondition::NotPlayedForCondition(chrono::seconds period) :
+    period(period),
+    cutoff(0)
+{
+    startEvaluation();
+}
+
+void NotPlayedForCondition::startEvaluation() const
+{
+    cutoff = chrono::system_clock::to_time_t(chrono::system_clock::now() - period);
+}
+
+bool NotPlayedForCondition::check(const shared_ptr<Track>& track) const
+{
+    auto lastPlayed = history::stats(track->id).lastPlayed;
+    return lastPlayed == 0 || lastPlayed < cutoff;
+}
+
+
 // LOGICAL
 LogicalCondition::LogicalCondition(vector<unique_ptr<Condition>> conditions) :
     conditions(move(conditions))
 {}
 
+void LogicalCondition::startEvaluation() const
+{
+    for (auto &cond : conditions)
+    {
+        cond->startEvaluation();
+    }
+}
+
 
 // AND
 bool AND_Condition::check(const shared_ptr<Track>& track) const
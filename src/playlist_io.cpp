@@ -0,0 +1,456 @@
+#include "playlist_io.hpp"
+#include "log.hpp"
+
+#include <fstream>
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <vector>
+#include <regex>
+#include <cstring>
+#include <cstdint>
+
+using namespace std;
+
+using data::Track;
+
+namespace playlistio
+{
+    /*
+       binary format, all integers are little-endian:
+
+       char[4]  magic "PLPL"
+       uint32   version
+       uint32   name length, name bytes
+       uint32   number of entries
+       entries: uint32 path length, path bytes (normalized absolute path)
+
+       The whole file is read with a single read and parsed in place
+       */
+    const char     binaryMagic[4] = { 'P', 'L', 'P', 'L' };
+    const uint32_t binaryVersion  = 1;
+
+    namespace
+    {
+        string toLower(string str)
+        {
+            transform(str.begin(), str.end(), str.begin(), [](unsigned char c) { return tolower(c); });
+            return str;
+        }
+
+        void trim(string& str)
+        {
+            // windows line endings and stray whitespace
+            while (!str.empty() && isspace(static_cast<unsigned char>(str.back())))
+            {
+                str.pop_back();
+            }
+            size_t start = 0;
+            while (start < str.size() && isspace(static_cast<unsigned char>(str[start])))
+            {
+                start++;
+            }
+            str.erase(0, start);
+        }
+
+        // editors save m3u8 files with a byte order mark in front of #EXTM3U
+        void stripBom(string& line)
+        {
+            if (line.compare(0, 3, "\xEF\xBB\xBF") == 0)
+            {
+                line.erase(0, 3);
+            }
+        }
+
+        bool isHex(char c)
+        {
+            return isxdigit(static_cast<unsigned char>(c));
+        }
+
+        // file:///path and file://localhost/path are local,
+        // returns false for a file on another host
+        bool decodeFileUrl(const string& url, string& path)
+        {
+            size_t start = url.find('/', strlen("file://"));
+            if (start == string::npos)
+            {
+                return false;
+            }
+            string host = toLower(url.substr(strlen("file://"), start - strlen("file://")));
+            if (!host.empty() && host != "localhost")
+            {
+                return false;
+            }
+
+            string ret;
+            for (size_t i = start; i < url.size(); i++)
+            {
+                if (url[i] == '%' && i + 2 < url.size() && isHex(url[i+1]) && isHex(url[i+2]))
+                {
+                    ret += static_cast<char>(stoi(url.substr(i+1, 2), nullptr, 16));
+                    i += 2;
+                }
+                else
+                {
+                    ret += url[i];
+                }
+            }
+            path = move(ret);
+            return true;
+        }
+
+        void addEntry(string entry, const string& baseDir, SimplePlaylist& playlist, ImportResult& result)
+        {
+            trim(entry);
+            if (entry.empty())
+            {
+                return;
+            }
+
+            bool fileUrl = toLower(entry.substr(0, strlen("file://"))) == "file://";
+            if ((fileUrl && !decodeFileUrl(entry, entry)) || (!fileUrl && entry.find("://") != string::npos))
+            {
+                log(LT::warning, "Playlist entry is not a local file: %s") % entry;
+                result.missing++;
+                return;
+            }
+
+            if (entry.front() != '/' && !baseDir.empty())
+            {
+                entry = baseDir + "/" + entry;
+            }
+
+            if (auto track = data::findTrack(entry))
+            {
+                playlist.addTrack(move(track));
+                result.added++;
+            }
+            else
+            {
+                log(LT::warning, "Playlist entry is not in the library: %s") % entry;
+                result.missing++;
+            }
+        }
+
+        ImportResult importM3U(istream& in, const string& baseDir, SimplePlaylist& playlist)
+        {
+            ImportResult result;
+
+            string line;
+            bool first = true;
+            while (getline(in, line))
+            {
+                if (first)
+                {
+                    stripBom(line);
+                    first = false;
+                }
+                if (!line.empty() && line.front() == '#')
+                {
+                    continue;
+                }
+                addEntry(move(line), baseDir, playlist, result);
+            }
+
+            return result;
+        }
+
+        ImportResult importPLS(istream& in, const string& baseDir, SimplePlaylist& playlist)
+        {
+            ImportResult result;
+
+            // entries may come in any order, FileN defines the position
+            vector<pair<long, string>> entries;
+            static const regex fileEntry("^\\s*[Ff][Ii][Ll][Ee]([0-9]+)\\s*=(.*)$");
+
+            string line;
+            smatch match;
+            bool first = true;
+            while (getline(in, line))
+            {
+                if (first)
+                {
+                    stripBom(line);
+                    first = false;
+                }
+                if (regex_match(line, match, fileEntry))
+                {
+                    entries.emplace_back(stol(match[1]), match[2]);
+                }
+            }
+
+            stable_sort(entries.begin(), entries.end(), [](const pair<long, string>& fst, const pair<long, string>& snd)
+            {
+                return fst.first < snd.first;
+            });
+
+            for (auto &entry : entries)
+            {
+                addEntry(move(entry.second), baseDir, playlist, result);
+            }
+
+            return result;
+        }
+
+        uint32_t readU32(const char* data)
+        {
+            const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+            return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+        }
+
+        void writeU32(ostream& out, uint32_t value)
+        {
+            char bytes[4] = {
+                static_cast<char>(value & 0xff),
+                static_cast<char>((value >> 8) & 0xff),
+                static_cast<char>((value >> 16) & 0xff),
+                static_cast<char>((value >> 24) & 0xff)
+            };
+            out.write(bytes, 4);
+        }
+
+        ImportResult importBinary(istream& in, SimplePlaylist& playlist)
+        {
+            ImportResult result;
+
+            string buffer{ istreambuf_iterator<char>(in), istreambuf_iterator<char>() };
+            const char* pos = buffer.data();
+            const char* end = buffer.data() + buffer.size();
+
+            auto fail = [&result](const char* reason)
+            {
+                log(LT::error, "Corrupted binary playlist: %s") % reason;
+                result.ok = false;
+                return result;
+            };
+
+            if (end - pos < 12 || memcmp(pos, binaryMagic, 4) != 0)
+            {
+                return fail("bad header");
+            }
+            if (readU32(pos + 4) != binaryVersion)
+            {
+                return fail("unsupported version");
+            }
+            pos += 8;
+
+            // lengths are compared in size_t, a corrupted one near 2^32 must not wrap
+            size_t nameLength = readU32(pos);
+            pos += 4;
+            if (nameLength > static_cast<size_t>(end - pos) || static_cast<size_t>(end - pos) - nameLength < 4)
+            {
+                return fail("truncated name");
+            }
+            result.name.assign(pos, nameLength);
+            pos += nameLength;
+
+            uint32_t count = readU32(pos);
+            pos += 4;
+
+            string path;
+            for (uint32_t i = 0; i < count; i++)
+            {
+                if (end - pos < 4)
+                {
+                    return fail("truncated entry");
+                }
+                size_t length = readU32(pos);
+                pos += 4;
+                if (static_cast<size_t>(end - pos) < length)
+                {
+                    return fail("truncated entry");
+                }
+
+                // paths are stored normalized, so there is no need to normalize them again
+                path.assign(pos, length);
+                pos += length;
+
+                auto track = data::tracksByPath.find(path);
+                if (track != data::tracksByPath.end())
+                {
+                    playlist.addTrack(track->second);
+                    result.added++;
+                }
+                else
+                {
+                    result.missing++;
+                }
+            }
+
+            if (result.missing != 0)
+            {
+                log(LT::warning, "%d entries of binary playlist %s are not in the library") % result.missing % playlist.name;
+            }
+
+            return result;
+        }
+
+        string baseName(const string& path)
+        {
+            string name = regex_replace(path, regex(".*/"), "");
+            return regex_replace(name, regex("\\.[^.]*$"), "");
+        }
+
+        string dirName(const string& path)
+        {
+            auto slash = path.rfind('/');
+            if (slash == string::npos)
+            {
+                return ".";
+            }
+            return path.substr(0, slash);
+        }
+    }
+
+    PlaylistFormat formatFromPath(const string& path)
+    {
+        auto dot = path.rfind('.');
+        if (dot == string::npos)
+        {
+            return PlaylistFormat::unknown;
+        }
+
+        string extension = toLower(path.substr(dot + 1));
+        if (extension == "m3u" || extension == "m3u8")
+        {
+            return PlaylistFormat::m3u;
+        }
+        if (extension == "pls")
+        {
+            return PlaylistFormat::pls;
+        }
+        if (extension == "plpl")
+        {
+            return PlaylistFormat::binary;
+        }
+        return PlaylistFormat::unknown;
+    }
+
+    ImportResult importPlaylist(istream& in, PlaylistFormat format, const string& baseDir, SimplePlaylist& playlist)
+    {
+        string dir = baseDir.empty() ? string() : data::normalizePath(baseDir);
+
+        switch (format)
+        {
+            case PlaylistFormat::m3u:
+                return importM3U(in, dir, playlist);
+            case PlaylistFormat::pls:
+                return importPLS(in, dir, playlist);
+            case PlaylistFormat::binary:
+                return importBinary(in, playlist);
+            default:
+                {
+                    log(LT::error, "Unknown playlist format");
+                    ImportResult result;
+                    result.ok = false;
+                    return result;
+                }
+        }
+    }
+
+    bool exportPlaylist(ostream& out, PlaylistFormat format, const SimplePlaylist& playlist)
+    {
+        auto tracks = playlist.getTracks();
+
+        switch (format)
+        {
+            case PlaylistFormat::m3u:
+                out << "#EXTM3U\n";
+                for (auto &track : tracks)
+                {
+                    out << "#EXTINF:-1,";
+                    if (!track->artistName.empty())
+                    {
+                        out << track->artistName << " - ";
+                    }
+                    out << track->name << '\n' << data::normalizePath(track->filepath) << '\n';
+                }
+                break;
+
+            case PlaylistFormat::pls:
+                {
+                    out << "[playlist]\n";
+                    size_t n = 1;
+                    for (auto &track : tracks)
+                    {
+                        out << "File"  << n << '=' << data::normalizePath(track->filepath) << '\n';
+                        out << "Title" << n << '=' << track->name << '\n';
+                        n++;
+                    }
+                    out << "NumberOfEntries=" << tracks.size() << '\n';
+                    out << "Version=2\n";
+                }
+                break;
+
+            case PlaylistFormat::binary:
+                out.write(binaryMagic, 4);
+                writeU32(out, binaryVersion);
+                writeU32(out, playlist.name.size());
+                out.write(playlist.name.data(), playlist.name.size());
+                writeU32(out, tracks.size());
+                for (auto &track : tracks)
+                {
+                    string path = data::normalizePath(track->filepath);
+                    writeU32(out, path.size());
+                    out.write(path.data(), path.size());
+                }
+                break;
+
+            default:
+                log(LT::error, "Unknown playlist format");
+                return false;
+        }
+
+        return static_cast<bool>(out);
+    }
+
+    shared_ptr<SimplePlaylist> loadPlaylist(const string& path)
+    {
+        auto format = formatFromPath(path);
+        if (format == PlaylistFormat::unknown)
+        {
+            log(LT::error, "Unknown playlist format: %s") % path;
+            return nullptr;
+        }
+
+        ifstream in(path, ios::binary);
+        if (!in)
+        {
+            log(LT::error, "Could not open playlist %s") % path;
+            return nullptr;
+        }
+
+        auto playlist = make_shared<SimplePlaylist>(baseName(path));
+        auto result = importPlaylist(in, format, dirName(path), *playlist);
+        if (!result.ok)
+        {
+            return nullptr;
+        }
+        if (!result.name.empty())
+        {
+            playlist->name = result.name;
+        }
+
+        log(LT::info, "Loaded playlist %s: %d tracks, %d missing") % path % result.added % result.missing;
+        return playlist;
+    }
+
+    bool savePlaylist(const string& path, const SimplePlaylist& playlist)
+    {
+        auto format = formatFromPath(path);
+        if (format == PlaylistFormat::unknown)
+        {
+            log(LT::error, "Unknown playlist format: %s") % path;
+            return false;
+        }
+
+        ofstream out(path, ios::binary);
+        if (!out || !exportPlaylist(out, format, playlist))
+        {
+            log(LT::error, "Could not write playlist %s") % path;
+            return false;
+        }
+
+        return true;
+    }
+}
@@ -0,0 +1,175 @@
+#include "prefetch.hpp"
+#include "io_throttle.hpp"
+#include "log.hpp"
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <condition_variable>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace std;
+using namespace chrono;
+
+namespace prefetch
+{
+    size_t lookahead     = 3;
+    size_t bytesPerTrack = 8 * 1024 * 1024;
+    size_t ioBudget      = 32 * 1024 * 1024;
+
+    namespace
+    {
+        const size_t readChunk = 512 * 1024;
+
+        thread             prefetchThread;
+        mutex              prefetchMutex;
+        condition_variable prefetchCondition;
+        bool               stopping = false;
+
+        // files still to be read, in playback order
+        deque<string>      pending;
+        // files that were read lately, so that they are not read on every track change
+        deque<string>      warm;
+
+        IoThrottle throttle;
+
+        bool isWarm(const string& path)
+        {
+            return find(warm.begin(), warm.end(), path) != warm.end();
+        }
+
+        // false if the file is no longer wanted
+        bool stillPending(const string& path)
+        {
+            lock_guard<mutex> lock(prefetchMutex);
+            return !stopping && find(pending.begin(), pending.end(), path) != pending.end();
+        }
+
+        // returns false if the file was not read as far as it should have been:
+        // it could not be read, or it stopped being wanted halfway
+        bool warmUp(const string& path)
+        {
+            auto started = steady_clock::now();
+
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+            {
+                return false;
+            }
+
+            struct stat info;
+            if (fstat(fd, &info) != 0)
+            {
+                close(fd);
+                return false;
+            }
+            off_t size = min<off_t>(info.st_size, bytesPerTrack);
+
+            // sequential access doubles the kernel's own readahead window for filesrc
+            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+            off_t done = 0;
+            while (done < size && stillPending(path))
+            {
+                size_t chunk = min<off_t>(readChunk, size - done);
+                throttle.take(chunk, ioBudget);
+                if (readahead(fd, done, chunk) != 0)
+                {
+                    break;
+                }
+                done += chunk;
+            }
+            close(fd);
+
+            log(LT::debug, "Prefetched %u KiB of %s in %.1f ms")
+                % (done / 1024)
+                % path
+                % (duration_cast<microseconds>(steady_clock::now() - started).count() / 1000.0);
+            return done == size;
+        }
+
+        void prefetchThreadFunc()
+        {
+            unique_lock<mutex> lock(prefetchMutex);
+            while (true)
+            {
+                prefetchCondition.wait(lock, [] { return stopping || !pending.empty(); });
+                if (stopping)
+                {
+                    return;
+                }
+
+                string path = pending.front();
+                lock.unlock();
+                bool complete = warmUp(path);
+                lock.lock();
+
+                // upcoming() may have replaced the list in the meantime
+                if (!pending.empty() && pending.front() == path)
+                {
+                    pending.pop_front();
+                }
+                // a file that was cut short is read again the next time it comes up
+                if (!complete)
+                {
+                    continue;
+                }
+                warm.push_back(path);
+                while (warm.size() > lookahead * 2)
+                {
+                    warm.pop_front();
+                }
+            }
+        }
+    }
+
+    void start()
+    {
+        {
+            lock_guard<mutex> lock(prefetchMutex);
+            stopping = false;
+        }
+        prefetchThread = thread(prefetchThreadFunc);
+    }
+
+    void end()
+    {
+        {
+            lock_guard<mutex> lock(prefetchMutex);
+            stopping = true;
+            pending.clear();
+        }
+        prefetchCondition.notify_one();
+
+        if (prefetchThread.joinable())
+        {
+            prefetchThread.join();
+        }
+        warm.clear();
+    }
+
+    void upcoming(vector<string> paths)
+    {
+        {
+            lock_guard<mutex> lock(prefetchMutex);
+            pending.clear();
+            for (auto& path : paths)
+            {
+                if (pending.size() == lookahead)
+                {
+                    break;
+                }
+                if (!isWarm(path))
+                {
+                    pending.push_back(move(path));
+                }
+            }
+        }
+        prefetchCondition.notify_one();
+    }
+}
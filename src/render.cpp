@@ -0,0 +1,328 @@
+#include "render.hpp"
+#include "data.hpp"
+#include "workers.hpp"
+#include "log.hpp"
+
+#include <set>
+#include <list>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cerrno>
+
+#include <sys/stat.h>
+
+#include <boost/format.hpp>
+
+using namespace std;
+using namespace chrono;
+
+using boost::format;
+
+using data::Track;
+
+namespace render
+{
+    namespace
+    {
+        struct Encoding
+        {
+            const char* name;
+            const char* extension;
+            // encoder and muxer, as for gst-launch
+            const char* elements;
+        };
+
+        const Encoding encodings[] =
+        {
+            { "opus",   "opus", "opusenc bitrate=128000 ! oggmux" },
+            { "vorbis", "ogg",  "vorbisenc quality=0.5 ! oggmux" },
+            { "flac",   "flac", "flacenc" },
+            { "mp3",    "mp3",  "lamemp3enc target=quality quality=2 ! id3v2mux" },
+            { "wav",    "wav",  "wavenc" },
+        };
+
+        // jobs waiting for a worker, per worker.
+        // a library worth of pipeline descriptions does not need to exist at once
+        const size_t queuedPerWorker = 2;
+
+        struct Job
+        {
+            shared_ptr<Track> track;
+            string path;
+            // set by the worker while the pipeline runs, for progress
+            Glib::RefPtr<Gst::Pipeline> pipeline;
+        };
+
+        mutex                   jobsMutex;
+        condition_variable      jobsCondition;
+        // queued and running
+        list<Job*>              active;
+        size_t                  done = 0;
+        size_t                  failed = 0;
+        // nanoseconds of audio in finished tracks
+        gint64                  renderedAudio = 0;
+
+        bool matches(const Track& track, const string& query)
+        {
+            if (query == "all")
+            {
+                return true;
+            }
+            if (query.compare(0, 7, "artist:") == 0)
+            {
+                return track.artistName == query.substr(7);
+            }
+            if (query.compare(0, 6, "album:") == 0)
+            {
+                return track.albumName == query.substr(6);
+            }
+            for (auto field : { &track.artistName, &track.albumName, &track.name, &track.filepath })
+            {
+                if (field->find(query) != string::npos)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        string pathComponent(const string& name, const string& fallback)
+        {
+            string ret = name.empty() ? fallback : name;
+            replace(ret.begin(), ret.end(), '/', '_');
+            if (ret == "." || ret == "..")
+            {
+                ret = fallback;
+            }
+            return ret;
+        }
+
+        bool makeDirectories(const string& path)
+        {
+            for (size_t slash = path.find('/', 1); ; slash = path.find('/', slash + 1))
+            {
+                string prefix = path.substr(0, slash);
+                if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST)
+                {
+                    return false;
+                }
+                if (slash == string::npos)
+                {
+                    return true;
+                }
+            }
+        }
+
+        bool renderTrack(Job& job, const Encoding& encoding, gint64& duration)
+        {
+            auto opened = job.track->open();
+            if (!opened.isValid())
+            {
+                return false;
+            }
+
+            // written next to the target and renamed once complete,
+            // so an interrupted run does not leave files that look finished
+            string partial = job.path + ".part";
+
+            // the C function reports errors instead of throwing them
+            string description = string("audioconvert ! audioresample ! ") + encoding.elements + " ! filesink name=out";
+            GError* error = nullptr;
+            GstElement* created = gst_parse_bin_from_description(description.c_str(), true, &error);
+            if (!created)
+            {
+                log(LT::error, "Could not create %s encoder: %s") % encoding.name % (error ? error->message : "unknown error");
+                g_clear_error(&error);
+                return false;
+            }
+            g_clear_error(&error);
+
+            auto tail = Glib::wrap(GST_BIN(created), false);
+            tail->get_element("out")->set_property("location", Glib::ustring(partial));
+
+            auto pipeline = Gst::Pipeline::create();
+            pipeline->add(opened.bin)->add(tail);
+            opened.pad->link(tail->get_static_pad("sink"));
+
+            {
+                lock_guard<mutex> lock(jobsMutex);
+                job.pipeline = pipeline;
+            }
+
+            pipeline->set_state(Gst::STATE_PLAYING);
+            auto message = pipeline->get_bus()->poll(Gst::MESSAGE_EOS | Gst::MESSAGE_ERROR, Gst::CLOCK_TIME_NONE);
+            bool ok = message && message->get_message_type() == Gst::MESSAGE_EOS;
+            if (!ok && message)
+            {
+                Glib::Error error;
+                string debug;
+                Glib::RefPtr<Gst::MessageError>::cast_static(message)->parse(error, debug);
+                log(LT::error, "Could not render %s: %s") % job.track->filepath % error.what();
+            }
+
+            if (!pipeline->query_position(Gst::FORMAT_TIME, duration))
+            {
+                duration = 0;
+            }
+
+            {
+                lock_guard<mutex> lock(jobsMutex);
+                job.pipeline.reset();
+            }
+            pipeline->set_state(Gst::STATE_NULL);
+
+            if (!ok || rename(partial.c_str(), job.path.c_str()) != 0)
+            {
+                remove(partial.c_str());
+                return false;
+            }
+            return true;
+        }
+
+        // audio covered so far, finished tracks and running ones
+        gint64 progress()
+        {
+            gint64 total = renderedAudio;
+            for (auto job : active)
+            {
+                gint64 position;
+                if (job->pipeline && job->pipeline->query_position(Gst::FORMAT_TIME, position))
+                {
+                    total += position;
+                }
+            }
+            return total;
+        }
+    }
+
+    bool run(const Options& options)
+    {
+        auto encoding = find_if(begin(encodings), end(encodings), [&](const Encoding& encoding)
+        {
+            return options.format == encoding.name;
+        });
+        if (encoding == end(encodings))
+        {
+            cerr << "Unknown format " << options.format << endl;
+            return false;
+        }
+
+        vector<shared_ptr<Track>> tracks;
+        for (auto &track : data::allArtists->getTracks())
+        {
+            if (matches(*track, options.query))
+            {
+                tracks.push_back(track);
+            }
+        }
+        if (tracks.empty())
+        {
+            cerr << "Nothing matches " << options.query << endl;
+            return false;
+        }
+
+        // declared before the pool, so that the workers are gone before the jobs
+        vector<Job> jobs(tracks.size());
+        WorkerPool pool(options.jobs);
+        size_t queueLimit = pool.size() * queuedPerWorker;
+        cout << format("Rendering %u tracks to %s with %u workers") % tracks.size() % encoding->name % pool.size() << endl;
+
+        auto started = steady_clock::now();
+
+        // jobsMutex has to be held
+        auto lastPrinted = started;
+        auto printProgress = [&]()
+        {
+            lastPrinted = steady_clock::now();
+            double elapsed = duration<double>(steady_clock::now() - started).count();
+            double audio = progress() / 1e9;
+            cout << format("\r%u/%u tracks, %.0f s of audio in %.0f s, %.1fx realtime")
+                % done % tracks.size() % audio % elapsed % (elapsed > 0 ? audio / elapsed : 0.0) << flush;
+        };
+
+        // tracks from different directories can have the same name
+        set<string> paths;
+
+        for (size_t i = 0; i < tracks.size(); i++)
+        {
+            Job& job = jobs[i];
+            job.track = tracks[i];
+
+            string directory = options.outDir + "/" + pathComponent(job.track->artistName, "unknown artist")
+                + "/" + pathComponent(job.track->albumName, "unknown album");
+            if (!makeDirectories(directory))
+            {
+                log(LT::error, "Could not create %s") % directory;
+                lock_guard<mutex> lock(jobsMutex);
+                done++;
+                failed++;
+                continue;
+            }
+
+            string base = job.track->filepath.substr(job.track->filepath.rfind('/') + 1);
+            base = base.substr(0, base.rfind('.'));
+            string stem = directory + "/" + pathComponent(base, "track");
+            job.path = stem + "." + encoding->extension;
+            for (size_t n = 2; !paths.insert(job.path).second; n++)
+            {
+                job.path = (format("%s (%u).%s") % stem % n % encoding->extension).str();
+            }
+
+            // most of the run is spent here, so progress is printed while waiting
+            unique_lock<mutex> lock(jobsMutex);
+            while (active.size() >= queueLimit)
+            {
+                jobsCondition.wait_for(lock, seconds(1));
+                if (steady_clock::now() - lastPrinted >= seconds(1))
+                {
+                    printProgress();
+                }
+            }
+            active.push_back(&job);
+            lock.unlock();
+
+            pool.submit([&job, encoding]
+            {
+                gint64 duration = 0;
+                bool ok = renderTrack(job, *encoding, duration);
+
+                lock_guard<mutex> lock(jobsMutex);
+                active.remove(&job);
+                done++;
+                if (ok)
+                {
+                    renderedAudio += duration;
+                }
+                else
+                {
+                    failed++;
+                }
+                jobsCondition.notify_all();
+            });
+        }
+
+        // the pool is shut down when run returns, this waits for the jobs themselves
+        unique_lock<mutex> lock(jobsMutex);
+        while (done < tracks.size())
+        {
+            jobsCondition.wait_for(lock, seconds(1));
+            printProgress();
+        }
+        cout << endl;
+
+        double elapsed = duration<double>(steady_clock::now() - started).count();
+        log(LT::info, "Rendered %u of %u tracks, %.1fx realtime")
+            % (done - failed) % tracks.size() % (elapsed > 0 ? renderedAudio / 1e9 / elapsed : 0.0);
+        if (failed)
+        {
+            cerr << failed << " tracks could not be rendered, see player.log" << endl;
+        }
+        return failed == 0;
+    }
+}
@@ -0,0 +1,120 @@
+#include "workers.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace
+{
+    // the pool the current thread works for, if any
+    thread_local const WorkerPool* currentPool = nullptr;
+}
+
+WorkerPool::WorkerPool(size_t threadCount)
+{
+    if (threadCount == 0)
+    {
+        threadCount = defaultThreadCount();
+    }
+
+    for (size_t i = 0; i < threadCount; i++)
+    {
+        threads.emplace_back(&WorkerPool::workerFunc, this);
+    }
+}
+
+void WorkerPool::submit(function<void()> job)
+{
+    {
+        lock_guard<mutex> lock(jobsMutex);
+        jobs.push_back(move(job));
+    }
+    jobsCondition.notify_one();
+}
+
+void WorkerPool::parallelFor(size_t count, size_t chunkSize, const function<void(size_t, size_t)>& func)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    chunkSize = max<size_t>(chunkSize, 1);
+
+    if (currentPool == this)
+    {
+        for (size_t begin = 0; begin < count; begin += chunkSize)
+        {
+            func(begin, min(begin + chunkSize, count));
+        }
+        return;
+    }
+
+    // every call has its own counter, so the pool can be shared between callers
+    size_t remaining = (count + chunkSize - 1) / chunkSize;
+    mutex doneMutex;
+    condition_variable doneCondition;
+
+    for (size_t begin = 0; begin < count; begin += chunkSize)
+    {
+        size_t end = min(begin + chunkSize, count);
+        submit([&, begin, end]
+        {
+            func(begin, end);
+
+            lock_guard<mutex> lock(doneMutex);
+            if (--remaining == 0)
+            {
+                doneCondition.notify_one();
+            }
+        });
+    }
+
+    unique_lock<mutex> lock(doneMutex);
+    doneCondition.wait(lock, [&] { return remaining == 0; });
+}
+
+size_t WorkerPool::size() const
+{
+    return threads.size();
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        lock_guard<mutex> lock(jobsMutex);
+        stopping = true;
+    }
+    jobsCondition.notify_all();
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+size_t WorkerPool::defaultThreadCount()
+{
+    return max(1u, thread::hardware_concurrency());
+}
+
+void WorkerPool::workerFunc()
+{
+    currentPool = this;
+    while (true)
+    {
+        function<void()> job;
+        {
+            unique_lock<mutex> lock(jobsMutex);
+            jobsCondition.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (jobs.empty())
+            {
+                return;
+            }
+
+            job = move(jobs.front());
+            jobs.pop_front();
+        }
+
+        job();
+    }
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <iostream>
+#include <cstdlib>
+
+// a failed check prints where it was and ends the test
+#define CHECK(condition) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": " #condition " failed" << std::endl; \
+            std::exit(1); \
+        } \
+    } \
+    while (false)
+
+// reported by ctest as skipped, see tests/CMakeLists.txt
+const int testSkipped = 77;
@@ -0,0 +1,61 @@
+#include "playback_harness.hpp"
+#include "media.hpp"
+#include "check.hpp"
+
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+using namespace chrono;
+
+// time from sending pause or resume until the playback thread
+// has acted on it and published the new state
+int main(int argc, char** argv)
+{
+    Gst::init(argc, argv);
+
+    string dir = tempDir();
+    CHECK(!dir.empty());
+    if (!makeTone(dir + "/tone.wav", "wavenc", 30))
+    {
+        return testSkipped;
+    }
+
+    PlaybackHarness harness;
+
+    auto track = make_shared<data::Track>(dir + "/tone.wav", "tone", "test", "test");
+    playback::sendPlaybackCommand(playback::Command::play({ track }, {}));
+    CHECK(PlaybackHarness::waitForState(playback::PlaybackState::playing, seconds(5)));
+
+    const int rounds = 200;
+    vector<double> latencies;
+    for (int i = 0; i < rounds; i++)
+    {
+        bool pause = i % 2 == 0;
+        auto expected = pause ? playback::PlaybackState::paused : playback::PlaybackState::playing;
+
+        auto sent = steady_clock::now();
+        playback::sendPlaybackCommand(pause ? playback::CommandType::pause : playback::CommandType::resume);
+        // sleeping would be coarser than what is measured
+        while (playback::nowPlaying().state != expected)
+        {
+            CHECK(steady_clock::now() - sent < seconds(5));
+            this_thread::yield();
+        }
+        latencies.push_back(duration_cast<nanoseconds>(steady_clock::now() - sent).count() / 1e6);
+
+        // lets the output settle, a command that arrives while the thread is busy measures something else
+        this_thread::sleep_for(milliseconds(5));
+    }
+
+    sort(latencies.begin(), latencies.end());
+    double median = latencies[latencies.size() / 2];
+    double p99 = latencies[latencies.size() * 99 / 100];
+    cout << "command latency: median " << median << " ms, p99 " << p99 << " ms, max " << latencies.back() << " ms" << endl;
+
+    CHECK(median < 1);
+    return 0;
+}
@@ -0,0 +1,57 @@
+#include "control_client.hpp"
+#include "media.hpp"
+#include "check.hpp"
+
+#include <cstdio>
+
+#include <sys/stat.h>
+
+using namespace std;
+
+// replies to commands that do not need anything to be playing
+int main()
+{
+    string dir = tempDir();
+    CHECK(!dir.empty());
+
+    ControlServer server(dir + "/player.sock");
+    CHECK(server.ready());
+
+    // only the owner may connect
+    struct stat info;
+    CHECK(stat(server.path.c_str(), &info) == 0);
+    CHECK((info.st_mode & 077) == 0);
+
+    // a running player and a file that is not a socket are left alone
+    CHECK(!control::run(server.path));
+    string file = dir + "/file";
+    CHECK(fclose(fopen(file.c_str(), "w")) == 0);
+    CHECK(!control::run(file));
+    CHECK(stat(file.c_str(), &info) == 0 && S_ISREG(info.st_mode));
+    remove(file.c_str());
+
+    ControlClient client(server.path);
+    CHECK(client.connected());
+
+    CHECK(client.request("status").compare(0, 14, "status stopped") == 0);
+    CHECK(client.request("next abc") == "error bad count");
+    CHECK(client.request("next -1") == "error bad count");
+    CHECK(client.request("previous 2x") == "error bad count");
+    CHECK(client.request("next 0") == "ok");
+    CHECK(client.request("jump x") == "error bad index");
+    CHECK(client.request("jump -1") == "error bad index");
+    CHECK(client.request("jump 99999999999999999999999") == "error bad index");
+    CHECK(client.request("seek abc") == "error bad position");
+    CHECK(client.request("seek inf") == "error bad position");
+    CHECK(client.request("seek -inf") == "error bad position");
+    CHECK(client.request("seek nan") == "error bad position");
+    CHECK(client.request("seek 1e300") == "error bad position");
+    CHECK(client.request("frobnicate") == "error unknown command frobnicate");
+
+    // replies come back in order when commands are sent without waiting
+    CHECK(client.send("next abc\nnext 0\njump x\n"));
+    CHECK(client.readLine() == "error bad count");
+    CHECK(client.readLine() == "ok");
+    CHECK(client.readLine() == "error bad index");
+    return 0;
+}
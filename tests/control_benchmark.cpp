@@ -0,0 +1,111 @@
+#include "control_client.hpp"
+#include "media.hpp"
+#include "check.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+using namespace chrono;
+
+namespace
+{
+    // every client sends status and waits for the reply, over and over
+    void roundTrips(const string& path, int clients)
+    {
+        const int requests = 2000;
+        vector<vector<int64_t>> latencies(clients);
+
+        auto start = steady_clock::now();
+        vector<thread> threads;
+        for (int c = 0; c < clients; c++)
+        {
+            threads.emplace_back([&, c]
+            {
+                ControlClient client(path);
+                CHECK(client.connected());
+                latencies[c].reserve(requests);
+                for (int i = 0; i < requests; i++)
+                {
+                    auto sent = steady_clock::now();
+                    CHECK(!client.request("status").empty());
+                    latencies[c].push_back(duration_cast<nanoseconds>(steady_clock::now() - sent).count());
+                }
+            });
+        }
+        for (auto& t : threads)
+        {
+            t.join();
+        }
+        double elapsed = duration_cast<nanoseconds>(steady_clock::now() - start).count() / 1e9;
+
+        vector<int64_t> all;
+        for (auto& client : latencies)
+        {
+            all.insert(all.end(), client.begin(), client.end());
+        }
+        sort(all.begin(), all.end());
+        cout << clients << " clients, one request at a time: median " << all[all.size() / 2] / 1e3
+            << " us, p99 " << all[all.size() * 99 / 100] / 1e3 << " us, "
+            << all.size() / elapsed << " requests/s" << endl;
+    }
+
+    // every client sends all of its commands at once and then reads the replies
+    void pipelined(const string& path, int clients)
+    {
+        const int requests = 10000;
+        string batch;
+        for (int i = 0; i < requests; i++)
+        {
+            batch += "status\n";
+        }
+
+        auto start = steady_clock::now();
+        vector<thread> threads;
+        for (int c = 0; c < clients; c++)
+        {
+            threads.emplace_back([&]
+            {
+                ControlClient client(path);
+                CHECK(client.connected());
+                // written from another thread, the server stops reading while its replies are not taken
+                thread writer([&] { CHECK(client.send(batch)); });
+                for (int i = 0; i < requests; i++)
+                {
+                    CHECK(!client.readLine().empty());
+                }
+                writer.join();
+            });
+        }
+        for (auto& t : threads)
+        {
+            t.join();
+        }
+        double elapsed = duration_cast<nanoseconds>(steady_clock::now() - start).count() / 1e9;
+        cout << clients << " clients, pipelined: " << clients * requests / elapsed << " requests/s" << endl;
+    }
+}
+
+int main()
+{
+    string dir = tempDir();
+    CHECK(!dir.empty());
+
+    ControlServer server(dir + "/player.sock");
+    CHECK(server.ready());
+
+    for (int clients : { 1, 8, 64 })
+    {
+        roundTrips(server.path, clients);
+    }
+    for (int clients : { 1, 8, 64 })
+    {
+        pipelined(server.path, clients);
+    }
+    return 0;
+}
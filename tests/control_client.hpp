@@ -0,0 +1,130 @@
+#pragma once
+
+#include "control.hpp"
+
+#include <string>
+#include <thread>
+#include <chrono>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// a blocking client for the control socket, one line per command and reply
+class ControlClient
+{
+    public:
+    // fd is negative if it could not connect
+    explicit ControlClient(const std::string& path)
+    {
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        path.copy(address.sun_path, sizeof(address.sun_path) - 1);
+        if (fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    ControlClient(const ControlClient&) = delete;
+    ControlClient& operator= (const ControlClient&) = delete;
+
+    ~ControlClient()
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+
+    bool connected() const
+    {
+        return fd >= 0;
+    }
+
+    // lines have to end with \n, several can be sent at once
+    bool send(const std::string& lines)
+    {
+        size_t written = 0;
+        while (written < lines.size())
+        {
+            ssize_t count = write(fd, lines.data() + written, lines.size() - written);
+            if (count <= 0)
+            {
+                return false;
+            }
+            written += count;
+        }
+        return true;
+    }
+
+    // empty if the server has gone away
+    std::string readLine()
+    {
+        while (true)
+        {
+            size_t end = buffered.find('\n');
+            if (end != std::string::npos)
+            {
+                std::string line = buffered.substr(0, end);
+                buffered.erase(0, end + 1);
+                return line;
+            }
+
+            char buffer[4096];
+            ssize_t count = read(fd, buffer, sizeof(buffer));
+            if (count <= 0)
+            {
+                return {};
+            }
+            buffered.append(buffer, count);
+        }
+    }
+
+    std::string request(const std::string& command)
+    {
+        return send(command + "\n") ? readLine() : std::string();
+    }
+
+    private:
+    int fd = -1;
+    std::string buffered;
+};
+
+// control::run() on its own thread, stopped with quit
+class ControlServer
+{
+    public:
+    explicit ControlServer(const std::string& path) :
+        path(path),
+        thread([path] { control::run(path); })
+    {
+    }
+
+    ~ControlServer()
+    {
+        ControlClient(path).request("quit");
+        thread.join();
+    }
+
+    // waits until the socket takes connections
+    bool ready()
+    {
+        for (int i = 0; i < 1000; i++)
+        {
+            if (ControlClient(path).connected())
+            {
+                return true;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        return false;
+    }
+
+    const std::string path;
+
+    private:
+    std::thread thread;
+};
@@ -0,0 +1,107 @@
+#include "playback_harness.hpp"
+#include "media.hpp"
+#include "check.hpp"
+
+#include <mutex>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <iostream>
+#include <ctime>
+
+using namespace std;
+using namespace chrono;
+
+namespace
+{
+    double cpuSeconds()
+    {
+        timespec ts;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+    }
+
+    struct Sample
+    {
+        double at;
+        double cpu;
+    };
+
+    // cores used between two points of the run
+    double cpuRate(const vector<Sample>& samples, double from, double to)
+    {
+        const Sample* first = nullptr;
+        const Sample* last = nullptr;
+        for (auto& sample : samples)
+        {
+            if (!first && sample.at >= from)
+            {
+                first = &sample;
+            }
+            if (sample.at <= to)
+            {
+                last = &sample;
+            }
+        }
+        CHECK(first && last && last->at > first->at);
+        return (last->cpu - first->cpu) / (last->at - first->at);
+    }
+}
+
+// two 5 s tracks with a 2 s crossfade play for 8 s, and fading
+// (two decoders, the mixer and volume changes every 20 ms) costs little
+// more than playing one track
+int main(int argc, char** argv)
+{
+    Gst::init(argc, argv);
+
+    string dir = tempDir();
+    CHECK(!dir.empty());
+    if (!makeTone(dir + "/a.wav", "wavenc", 5, 440) || !makeTone(dir + "/b.wav", "wavenc", 5, 660))
+    {
+        return testSkipped;
+    }
+
+    setenv("PLAYER_CROSSFADE", "2", 1);
+    PlaybackHarness harness;
+    CHECK(output::crossfadeEnabled());
+
+    mutex arrivalsMutex;
+    vector<steady_clock::time_point> arrivals;
+    harness.sinkPad()->add_probe(Gst::PAD_PROBE_TYPE_BUFFER, [&](const Glib::RefPtr<Gst::Pad>&, const Gst::PadProbeInfo&)
+    {
+        lock_guard<mutex> lock(arrivalsMutex);
+        arrivals.push_back(steady_clock::now());
+        return Gst::PAD_PROBE_OK;
+    });
+
+    auto a = make_shared<data::Track>(dir + "/a.wav", "a", "test", "test");
+    auto b = make_shared<data::Track>(dir + "/b.wav", "b", "test", "test");
+    playback::sendPlaybackCommand(playback::Command::play({ a, b }, {}));
+    CHECK(PlaybackHarness::waitForState(playback::PlaybackState::playing, seconds(5)));
+
+    auto start = steady_clock::now();
+    vector<Sample> samples;
+    while (playback::nowPlaying().state != playback::PlaybackState::stopped)
+    {
+        samples.push_back({ duration_cast<nanoseconds>(steady_clock::now() - start).count() / 1e9, cpuSeconds() });
+        CHECK(samples.back().at < 15);
+        this_thread::sleep_for(milliseconds(50));
+    }
+
+    double played;
+    {
+        lock_guard<mutex> lock(arrivalsMutex);
+        CHECK(!arrivals.empty());
+        played = duration_cast<milliseconds>(arrivals.back() - arrivals.front()).count() / 1e3;
+    }
+    double single = cpuRate(samples, 0.5, 2.5);
+    double fading = cpuRate(samples, 3.2, 4.8);
+    cout << "played " << played << " s, CPU " << single * 100 << "% of a core for one track, "
+        << fading * 100 << "% while fading, " << (fading - single) * 100 << "% for the overlap" << endl;
+
+    CHECK(played > 7.5 && played < 8.5);
+    // the overlap costs at most 5% of a core on top of normal playback
+    CHECK(fading - single < 0.05);
+    return 0;
+}
@@ -0,0 +1,70 @@
+#include "playback_harness.hpp"
+#include "media.hpp"
+#include "check.hpp"
+
+#include <mutex>
+#include <vector>
+#include <chrono>
+#include <iostream>
+
+using namespace std;
+using namespace chrono;
+
+// measures the silence between two tracks played one after another.
+// fakesink plays in real time, so a buffer reaches its pad when the one
+// before it has been played. if there was no gap, the time between the
+// second and the last buffer is the duration of everything in between
+int main(int argc, char** argv)
+{
+    Gst::init(argc, argv);
+
+    string dir = tempDir();
+    CHECK(!dir.empty());
+    if (!makeTone(dir + "/a.wav", "wavenc", 1, 440) || !makeTone(dir + "/b.wav", "wavenc", 1, 660))
+    {
+        return testSkipped;
+    }
+
+    PlaybackHarness harness;
+
+    struct Arrival
+    {
+        steady_clock::time_point at;
+        gint64 duration;
+    };
+    mutex arrivalsMutex;
+    vector<Arrival> arrivals;
+
+    harness.sinkPad()->add_probe(Gst::PAD_PROBE_TYPE_BUFFER,
+            [&](const Glib::RefPtr<Gst::Pad>&, const Gst::PadProbeInfo& info)
+    {
+        lock_guard<mutex> lock(arrivalsMutex);
+        arrivals.push_back({ steady_clock::now(), static_cast<gint64>(info.get_buffer()->get_duration()) });
+        return Gst::PAD_PROBE_OK;
+    });
+
+    auto a = make_shared<data::Track>(dir + "/a.wav", "a", "test", "test");
+    auto b = make_shared<data::Track>(dir + "/b.wav", "b", "test", "test");
+    playback::sendPlaybackCommand(playback::Command::play({ a, b }, {}));
+
+    CHECK(PlaybackHarness::waitForState(playback::PlaybackState::playing, seconds(5)));
+    CHECK(PlaybackHarness::waitForState(playback::PlaybackState::stopped, seconds(10)));
+
+    lock_guard<mutex> lock(arrivalsMutex);
+    CHECK(arrivals.size() > 3);
+
+    gint64 played = 0;
+    for (size_t i = 1; i + 1 < arrivals.size(); i++)
+    {
+        played += arrivals[i].duration;
+    }
+    gint64 elapsed = duration_cast<nanoseconds>(arrivals.back().at - arrivals[1].at).count();
+    double gap = (elapsed - played) / 1e6;
+
+    cout << "gap between tracks: " << gap << " ms" << endl;
+    // scheduling jitter of a loaded machine, a real gap is a track switch long
+    CHECK(gap < 30);
+    // the queue running dry at the end is not an underrun
+    CHECK(output::latencyStats().underruns == 0);
+    return 0;
+}
@@ -0,0 +1,50 @@
+#include "history.hpp"
+#include "playlist.hpp"
+#include "media.hpp"
+#include "check.hpp"
+
+#include <chrono>
+#include <cstdio>
+
+#include <unistd.h>
+
+using namespace std;
+using namespace chrono;
+
+int main()
+{
+    string dir = tempDir();
+    CHECK(!dir.empty());
+    string path = dir + "/player.history";
+    history::historyPath = path.c_str();
+
+    auto skipped = make_shared<data::Track>("/music/skipped.flac", "skipped", "artist", "album");
+    auto played  = make_shared<data::Track>("/music/played.flac", "played", "artist", "album");
+
+    history::init();
+    history::record(skipped, 0.01);
+    history::record(played, 0.9);
+    // waits for the writer
+    history::end();
+
+    // stats are rebuilt from the file
+    history::init();
+    CHECK(history::stats(skipped->id).playCount == 0);
+    CHECK(history::stats(skipped->id).lastPlayed == 0);
+    CHECK(history::stats(played->id).playCount == 1);
+    CHECK(history::stats(played->id).lastPlayed != 0);
+
+    NotPlayedForCondition notForADay(hours(24));
+    notForADay.startEvaluation();
+    CHECK(notForADay.check(skipped));
+    CHECK(!notForADay.check(played));
+
+    NotPlayedForCondition notForAMoment(seconds(-60));
+    notForAMoment.startEvaluation();
+    CHECK(notForAMoment.check(played));
+
+    history::end();
+    remove(path.c_str());
+    rmdir(dir.c_str());
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include "indexed_sequence.hpp"
+#include "check.hpp"
+
+#include <vector>
+#include <thread>
+#include <random>
+#include <algorithm>
+
+using namespace std;
+
+int main()
+{
+    // the same random edits on a vector and on the sequence,
+    // with a read after every one of them as the UI does
+    IndexedSequence<int> sequence;
+    vector<int> expected;
+    vector<IndexedSequence<int>::Handle> handles;
+    mt19937 random(1);
+
+    for (int i = 0; i < 20000; i++)
+    {
+        size_t size = expected.size();
+        switch (size == 0 ? 0 : random() % 4)
+        {
+            case 0:
+            case 1:
+                {
+                    size_t pos = random() % (size + 1);
+                    handles.insert(handles.begin() + pos, sequence.insert(pos, i));
+                    expected.insert(expected.begin() + pos, i);
+                }
+                break;
+            case 2:
+                {
+                    size_t pos = random() % size;
+                    sequence.erase(handles[pos]);
+                    handles.erase(handles.begin() + pos);
+                    expected.erase(expected.begin() + pos);
+                }
+                break;
+            case 3:
+                {
+                    size_t from = random() % size;
+                    size_t to = random() % size;
+                    sequence.move(from, to);
+                    auto handle = handles[from];
+                    int value = expected[from];
+                    handles.erase(handles.begin() + from);
+                    expected.erase(expected.begin() + from);
+                    handles.insert(handles.begin() + to, handle);
+                    expected.insert(expected.begin() + to, value);
+                }
+                break;
+        }
+
+        CHECK(sequence.size() == expected.size());
+        if (!expected.empty())
+        {
+            size_t pos = random() % expected.size();
+            CHECK(sequence.at(pos) == expected[pos]);
+            CHECK(sequence.position(handles[pos]) == pos);
+        }
+    }
+    CHECK(equal(sequence.begin(), sequence.end(), expected.begin(), expected.end()));
+
+    // readers at the same time, nothing is written by at()
+    vector<thread> readers;
+    for (int t = 0; t < 4; t++)
+    {
+        readers.emplace_back([&]
+        {
+            for (size_t pos = 0; pos < expected.size(); pos++)
+            {
+                CHECK(sequence.at(pos) == expected[pos]);
+            }
+        });
+    }
+    for (auto& reader : readers)
+    {
+        reader.join();
+    }
+
+    return 0;
+}
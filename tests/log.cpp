@@ -0,0 +1,50 @@
+#include "log.hpp"
+#include "check.hpp"
+
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// lines logged from many threads at once come out whole
+int main()
+{
+    const int threadCount = 8;
+    const int lines = 2000;
+
+    vector<thread> threads;
+    for (int t = 0; t < threadCount; t++)
+    {
+        threads.emplace_back([t]
+        {
+            for (int i = 0; i < lines; i++)
+            {
+                log(LT::debug, "log test %d %d end") % t % i;
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    ifstream in("player.log");
+    string line;
+    int found = 0;
+    while (getline(in, line))
+    {
+        auto start = line.find("log test ");
+        if (start == string::npos)
+        {
+            continue;
+        }
+        CHECK(line.compare(line.size() - 4, 4, " end") == 0);
+        CHECK(line.find("log test ", start + 1) == string::npos);
+        found++;
+    }
+    CHECK(found == threadCount * lines);
+
+    return 0;
+}
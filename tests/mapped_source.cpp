@@ -0,0 +1,58 @@
+#include "mapped_source.hpp"
+#include "media.hpp"
+#include "check.hpp"
+
+#include <chrono>
+#include <thread>
+
+#include <unistd.h>
+
+using namespace std;
+using namespace chrono;
+
+// a file that is cut short while it is read from the mapping
+// ends the stream instead of the process
+int main(int argc, char** argv)
+{
+    Gst::init(argc, argv);
+
+    string dir = tempDir();
+    CHECK(!dir.empty());
+    string path = dir + "/tone.wav";
+    if (!makeTone(path, "wavenc", 10))
+    {
+        return testSkipped;
+    }
+
+    auto src = mappedsource::create(path);
+    CHECK(src);
+    auto decode = Gst::ElementFactory::create_element("decodebin");
+    auto sink = Gst::ElementFactory::create_element("fakesink");
+    CHECK(decode && sink);
+    // real time, so that the file is cut while it plays
+    sink->set_property("sync", true);
+
+    auto pipeline = Gst::Pipeline::create();
+    pipeline->add(src)->add(decode)->add(sink);
+    src->link(decode);
+    decode->signal_pad_added().connect([sink](const Glib::RefPtr<Gst::Pad>& pad)
+    {
+        pad->link(sink->get_static_pad("sink"));
+    });
+
+    pipeline->set_state(Gst::STATE_PLAYING);
+    this_thread::sleep_for(seconds(1));
+    CHECK(truncate(path.c_str(), 4096) == 0);
+
+    auto started = steady_clock::now();
+    auto message = pipeline->get_bus()->poll(Gst::MESSAGE_EOS | Gst::MESSAGE_ERROR, 15 * Gst::SECOND);
+    pipeline->set_state(Gst::STATE_NULL);
+
+    CHECK(message);
+    // the 10 s would have played out otherwise
+    CHECK(steady_clock::now() - started < seconds(8));
+
+    unlink(path.c_str());
+    rmdir(dir.c_str());
+    return 0;
+}
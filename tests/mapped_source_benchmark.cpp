@@ -0,0 +1,92 @@
+#include "data.hpp"
+#include "loudness.hpp"
+#include "media.hpp"
+#include "check.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <ctime>
+#include <cstdlib>
+
+#include <unistd.h>
+
+using namespace std;
+
+namespace
+{
+    // read(2) and friends made by the process so far
+    uint64_t readSyscalls()
+    {
+        ifstream io("/proc/self/io");
+        string key;
+        uint64_t value;
+        while (io >> key >> value)
+        {
+            if (key == "syscr:")
+            {
+                return value;
+            }
+        }
+        return 0;
+    }
+
+    double cpuSeconds()
+    {
+        timespec ts;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+    }
+
+    // plays the whole file as fast as it can be read and decoded
+    void decode(const data::Track& track, const char* mode)
+    {
+        auto opened = track.open();
+        CHECK(opened.isValid());
+
+        auto pipeline = Gst::Pipeline::create();
+        auto sink = Gst::ElementFactory::create_element("fakesink");
+        CHECK(sink);
+        sink->set_property("sync", false);
+        pipeline->add(opened.bin)->add(sink);
+        opened.pad->link(sink->get_static_pad("sink"));
+
+        uint64_t syscalls = readSyscalls();
+        double cpu = cpuSeconds();
+        pipeline->set_state(Gst::STATE_PLAYING);
+        auto message = pipeline->get_bus()->poll(Gst::MESSAGE_EOS | Gst::MESSAGE_ERROR, Gst::CLOCK_TIME_NONE);
+        CHECK(message && message->get_message_type() == Gst::MESSAGE_EOS);
+        cpu = cpuSeconds() - cpu;
+        syscalls = readSyscalls() - syscalls;
+        pipeline->set_state(Gst::STATE_NULL);
+
+        cout << mode << ": " << syscalls << " read syscalls, " << cpu * 1000 << " ms of CPU" << endl;
+    }
+}
+
+// the same file read by filesrc and from a mapping
+int main(int argc, char** argv)
+{
+    Gst::init(argc, argv);
+    loudness::mode = loudness::GainMode::off;
+
+    string dir = tempDir();
+    CHECK(!dir.empty());
+    string path = dir + "/tone.wav";
+    if (!makeTone(path, "wavenc", 300))
+    {
+        return testSkipped;
+    }
+    data::Track track(path, "tone", "test", "test");
+
+    for (int round = 0; round < 2; round++)
+    {
+        setenv("PLAYER_MMAP", "0", 1);
+        decode(track, "filesrc");
+        setenv("PLAYER_MMAP", "1", 1);
+        decode(track, "mapped");
+    }
+
+    unlink(path.c_str());
+    rmdir(dir.c_str());
+    return 0;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <gstreamermm.h>
+
+#include <string>
+#include <cstdlib>
+
+// a fresh directory for the files a test writes, under /tmp unless
+// the test needs a real disk (/tmp may be kept in memory)
+inline std::string tempDir(const std::string& parent = "/tmp")
+{
+    std::string path = parent + "/player-test-XXXXXX";
+    return mkdtemp(&path[0]) ? path : "";
+}
+
+// writes a stereo 44.1 kHz sine tone through an encoder description
+// such as "wavenc" or "vorbisenc ! oggmux".
+// returns false if an element is missing or the file could not be written
+inline bool makeTone(const std::string& path, const std::string& encoder, double seconds, int frequency = 440)
+{
+    // 10 ms buffers
+    std::string description = "audiotestsrc num-buffers=" + std::to_string(static_cast<int>(seconds * 100))
+        + " samplesperbuffer=441 freq=" + std::to_string(frequency)
+        + " ! audio/x-raw,rate=44100,channels=2 ! audioconvert ! " + encoder
+        + " ! filesink location=\"" + path + "\"";
+
+    GError* error = nullptr;
+    GstElement* created = gst_parse_bin_from_description(description.c_str(), false, &error);
+    g_clear_error(&error);
+    if (!created)
+    {
+        return false;
+    }
+
+    auto pipeline = Gst::Pipeline::create();
+    pipeline->add(Glib::wrap(GST_BIN(created), false));
+    pipeline->set_state(Gst::STATE_PLAYING);
+    auto message = pipeline->get_bus()->poll(Gst::MESSAGE_EOS | Gst::MESSAGE_ERROR, Gst::CLOCK_TIME_NONE);
+    bool ok = message && message->get_message_type() == Gst::MESSAGE_EOS;
+    pipeline->set_state(Gst::STATE_NULL);
+    return ok;
+}
@@ -0,0 +1,79 @@
+#include "mpsc_queue.hpp"
+#include "check.hpp"
+
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// producers push numbered values as fast as they can into a small queue,
+// so it is full most of the time. every value has to come out exactly once
+// and the values of one producer in the order they were pushed
+int main()
+{
+    const int producers = 8;
+    const uint64_t perProducer = 200000;
+
+    struct Value
+    {
+        int producer = -1;
+        uint64_t number = 0;
+    };
+    MpscQueue<Value> queue(16);
+    CHECK(queue.capacity() == 16);
+
+    vector<thread> threads;
+    for (int p = 0; p < producers; p++)
+    {
+        threads.emplace_back([&queue, p, perProducer]
+        {
+            for (uint64_t i = 0; i < perProducer; i++)
+            {
+                Value value;
+                value.producer = p;
+                value.number = i;
+                while (!queue.push(move(value)))
+                {
+                    this_thread::yield();
+                }
+            }
+        });
+    }
+
+    vector<uint64_t> expected(producers, 0);
+    uint64_t received = 0;
+    while (received < producers * perProducer)
+    {
+        Value value;
+        if (!queue.pop(value))
+        {
+            this_thread::yield();
+            continue;
+        }
+        CHECK(value.producer >= 0 && value.producer < producers);
+        CHECK(value.number == expected[value.producer]);
+        expected[value.producer]++;
+        received++;
+    }
+
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+
+    Value value;
+    CHECK(!queue.pop(value));
+    for (int p = 0; p < producers; p++)
+    {
+        CHECK(expected[p] == perProducer);
+    }
+
+    // a full queue refuses and leaves the value alone
+    MpscQueue<vector<int>> small(2);
+    CHECK(small.push(vector<int>{ 1 }));
+    CHECK(small.push(vector<int>{ 2 }));
+    vector<int> third{ 3 };
+    CHECK(!small.push(move(third)));
+    CHECK(third.size() == 1);
+    return 0;
+}
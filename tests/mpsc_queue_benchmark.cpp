@@ -0,0 +1,119 @@
+#include "mpsc_queue.hpp"
+#include "check.hpp"
+
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+using namespace chrono;
+
+namespace
+{
+    int64_t nowNs()
+    {
+        return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    // all producers push as fast as they can, the consumer spins on pop
+    void throughput(int producers)
+    {
+        const uint64_t perProducer = 1000000 / producers;
+        MpscQueue<uint64_t> queue(1024);
+
+        auto start = steady_clock::now();
+        vector<thread> threads;
+        for (int p = 0; p < producers; p++)
+        {
+            threads.emplace_back([&]
+            {
+                for (uint64_t i = 0; i < perProducer; i++)
+                {
+                    uint64_t value = i;
+                    while (!queue.push(move(value)))
+                    {
+                        this_thread::yield();
+                    }
+                }
+            });
+        }
+
+        uint64_t received = 0;
+        uint64_t value;
+        while (received < producers * perProducer)
+        {
+            if (queue.pop(value))
+            {
+                received++;
+            }
+            else
+            {
+                this_thread::yield();
+            }
+        }
+        for (auto& t : threads)
+        {
+            t.join();
+        }
+
+        double elapsed = duration_cast<nanoseconds>(steady_clock::now() - start).count() / 1e9;
+        cout << producers << " producers: " << (received / elapsed / 1e6) << " M values/s" << endl;
+    }
+
+    // one value at a time, from the push until the spinning consumer has it
+    void latency()
+    {
+        const int rounds = 100000;
+        MpscQueue<int64_t> queue(1024);
+        atomic<bool> done{ false };
+        vector<int64_t> latencies;
+        latencies.reserve(rounds);
+
+        thread consumer([&]
+        {
+            int64_t sentAt;
+            while (latencies.size() < rounds)
+            {
+                if (queue.pop(sentAt))
+                {
+                    latencies.push_back(nowNs() - sentAt);
+                    done = true;
+                }
+                else
+                {
+                    // with fewer cores than threads spinning alone never lets the producer run
+                    this_thread::yield();
+                }
+            }
+        });
+
+        for (int i = 0; i < rounds; i++)
+        {
+            int64_t sentAt = nowNs();
+            CHECK(queue.push(move(sentAt)));
+            while (!done.exchange(false))
+            {
+                this_thread::yield();
+            }
+        }
+        consumer.join();
+
+        sort(latencies.begin(), latencies.end());
+        cout << "push to pop: median " << latencies[rounds / 2] << " ns, p99 "
+            << latencies[rounds * 99 / 100] << " ns" << endl;
+    }
+}
+
+int main()
+{
+    unsigned cores = max(thread::hardware_concurrency(), 2u);
+    for (int producers = 1; producers < static_cast<int>(cores); producers *= 2)
+    {
+        throughput(producers);
+    }
+    latency();
+    return 0;
+}
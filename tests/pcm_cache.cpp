@@ -0,0 +1,100 @@
+#include "playback_harness.hpp"
+#include "media.hpp"
+#include "check.hpp"
+
+#include <mutex>
+#include <chrono>
+#include <iostream>
+
+using namespace std;
+using namespace chrono;
+
+namespace
+{
+    void playToEnd(const shared_ptr<data::Track>& track)
+    {
+        playback::sendPlaybackCommand(playback::Command::play({ track }, {}));
+        CHECK(PlaybackHarness::waitForState(playback::PlaybackState::playing, seconds(5)));
+        CHECK(PlaybackHarness::waitForState(playback::PlaybackState::stopped, seconds(10)));
+    }
+}
+
+// with a 1 MiB cache: a track played to the end is played from memory
+// the next time, a track that was stopped keeps its beginning and plays
+// whole from it and the file, and recordings push the least recently
+// used tracks out. 2 s of 16 bit stereo is two 256 KiB blocks, so two tracks fit
+int main(int argc, char** argv)
+{
+    Gst::init(argc, argv);
+
+    string dir = tempDir();
+    CHECK(!dir.empty());
+    if (!makeTone(dir + "/a.wav", "wavenc", 2, 440) || !makeTone(dir + "/b.wav", "wavenc", 2, 550)
+            || !makeTone(dir + "/c.wav", "wavenc", 2, 660))
+    {
+        return testSkipped;
+    }
+
+    setenv("PLAYER_PCM_CACHE", "1", 1);
+    PlaybackHarness harness;
+    CHECK(pcmcache::enabled());
+
+    mutex playedMutex;
+    gint64 played = 0;
+    harness.sinkPad()->add_probe(Gst::PAD_PROBE_TYPE_BUFFER,
+            [&](const Glib::RefPtr<Gst::Pad>&, const Gst::PadProbeInfo& info)
+    {
+        lock_guard<mutex> lock(playedMutex);
+        played += info.get_buffer()->get_duration();
+        return Gst::PAD_PROBE_OK;
+    });
+    auto takePlayed = [&]
+    {
+        lock_guard<mutex> lock(playedMutex);
+        double ret = played / 1e9;
+        played = 0;
+        return ret;
+    };
+
+    auto a = make_shared<data::Track>(dir + "/a.wav", "a", "test", "test");
+    auto b = make_shared<data::Track>(dir + "/b.wav", "b", "test", "test");
+    auto c = make_shared<data::Track>(dir + "/c.wav", "c", "test", "test");
+
+    // a hit after a replay
+    playToEnd(a);
+    CHECK(PlaybackHarness::waitFor([] { return pcmcache::stats().tracks == 1; }, seconds(5)));
+    playToEnd(a);
+    auto stats = pcmcache::stats();
+    CHECK(stats.misses == 1 && stats.hits == 1);
+    takePlayed();
+
+    // the beginning of a track that was stopped
+    playback::sendPlaybackCommand(playback::Command::play({ b }, {}));
+    CHECK(PlaybackHarness::waitFor([] { return playback::nowPlaying().position > static_cast<gint64>(500 * Gst::MILLI_SECOND); }, seconds(5)));
+    playback::sendPlaybackCommand(playback::CommandType::stop);
+    CHECK(PlaybackHarness::waitForState(playback::PlaybackState::stopped, seconds(5)));
+    CHECK(PlaybackHarness::waitFor([] { return pcmcache::stats().tracks == 2; }, seconds(5)));
+    takePlayed();
+
+    // the cached part and the file join without a gap or an overlap
+    playToEnd(b);
+    double replayed = takePlayed();
+    stats = pcmcache::stats();
+    cout << "replayed " << replayed << " s of a track started from its cached beginning" << endl;
+    CHECK(stats.misses == 2 && stats.hits == 2);
+    CHECK(replayed > 1.95 && replayed < 2.05);
+
+    // recording all of b did not fit next to a and the beginning of b,
+    // c fits next to b
+    playToEnd(c);
+    CHECK(PlaybackHarness::waitFor([] { return pcmcache::stats().misses == 3; }, seconds(5)));
+    CHECK(PlaybackHarness::waitFor([] { return pcmcache::stats().tracks == 2; }, seconds(5)));
+    stats = pcmcache::stats();
+    cout << stats.tracks << " tracks, " << stats.bytes / 1024 << " KiB kept" << endl;
+    CHECK(stats.bytes <= pcmcache::memoryLimit);
+
+    // a was used least recently, it is the one that was dropped
+    playToEnd(a);
+    CHECK(pcmcache::stats().misses == 4);
+    return 0;
+}
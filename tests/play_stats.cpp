@@ -0,0 +1,55 @@
+#include "playback_harness.hpp"
+#include "play_stats.hpp"
+#include "media.hpp"
+#include "check.hpp"
+
+#include <chrono>
+#include <iostream>
+
+using namespace std;
+using namespace chrono;
+
+// plays two tracks and checks what was recorded for them: the current
+// one while it plays, both once they are detached, in the order they played
+int main(int argc, char** argv)
+{
+    Gst::init(argc, argv);
+
+    string dir = tempDir();
+    CHECK(!dir.empty());
+    if (!makeTone(dir + "/a.wav", "wavenc", 0.5, 440) || !makeTone(dir + "/b.ogg", "vorbisenc ! oggmux", 0.5, 660))
+    {
+        return testSkipped;
+    }
+
+    PlaybackHarness harness;
+
+    playstats::TrackStats stats;
+    CHECK(!playstats::currentStats(stats));
+
+    auto a = make_shared<data::Track>(dir + "/a.wav", "a", "test", "test");
+    auto b = make_shared<data::Track>(dir + "/b.ogg", "b", "test", "test");
+    playback::sendPlaybackCommand(playback::Command::play({ a, b }, {}));
+
+    CHECK(PlaybackHarness::waitForState(playback::PlaybackState::playing, seconds(5)));
+    CHECK(PlaybackHarness::waitFor([&] { return playstats::currentStats(stats); }, seconds(5)));
+    CHECK(stats.filepath == a->filepath);
+
+    CHECK(PlaybackHarness::waitForState(playback::PlaybackState::stopped, seconds(10)));
+    CHECK(PlaybackHarness::waitFor([] { return playstats::recent().size() == 2; }, seconds(5)));
+    CHECK(!playstats::currentStats(stats));
+
+    auto recent = playstats::recent();
+    CHECK(recent[0].filepath == a->filepath);
+    CHECK(recent[1].filepath == b->filepath);
+    for (auto& track : recent)
+    {
+        cout << track.filepath << ": PAUSED after " << track.toPaused / 1e6 << " ms, first buffer after "
+            << track.firstBuffer / 1e6 << " ms, " << track.decoderCpu / 1e6 << " ms of decoder CPU" << endl;
+        CHECK(track.toPaused >= 0);
+        CHECK(track.firstBuffer >= 0);
+        CHECK(track.decoderCpu > 0);
+        CHECK(track.errors == 0);
+    }
+    return 0;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "play.hpp"
+#include "output.hpp"
+#include "loudness.hpp"
+#include "pcm_cache.hpp"
+
+#include <gstreamermm.h>
+
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <cstdlib>
+
+/*
+   The playback engine as the daemon runs it, without a sound card.
+
+   Gst::init() has to be called first. Environment variables the modules
+   read on init can be set before the harness is created, the sink is
+   fakesink unless one is passed.
+   Tracks for it are made with data::Track's tag constructor,
+   so nothing has to be scanned into the library
+   */
+class PlaybackHarness
+{
+    public:
+    explicit PlaybackHarness(const char* sink = "fakesink")
+    {
+        setenv("PLAYER_AUDIO_SINK", sink, 1);
+        // tests that want the cache turn it on themselves
+        setenv("PLAYER_PCM_CACHE", "0", 0);
+
+        data::init();
+        loudness::mode = loudness::GainMode::off;
+        pcmcache::init();
+        playback::init();
+    }
+
+    PlaybackHarness(const PlaybackHarness&) = delete;
+    PlaybackHarness& operator= (const PlaybackHarness&) = delete;
+
+    ~PlaybackHarness()
+    {
+        playback::end();
+        pcmcache::end();
+        data::end();
+    }
+
+    // every buffer that is played passes it
+    Glib::RefPtr<Gst::Pad> sinkPad()
+    {
+        return output::pipeline->get_element("sink")->get_static_pad("sink");
+    }
+
+    // returns false if the condition did not become true in time
+    static bool waitFor(const std::function<bool()>& condition, std::chrono::milliseconds timeout)
+    {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (!condition())
+        {
+            if (std::chrono::steady_clock::now() > deadline)
+            {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+
+    static bool waitForState(playback::PlaybackState state, std::chrono::milliseconds timeout)
+    {
+        return waitFor([state] { return playback::nowPlaying().state == state; }, timeout);
+    }
+};
@@ -0,0 +1,122 @@
+#include "playback_queue.hpp"
+#include "shuffle.hpp"
+#include "check.hpp"
+
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    PlaybackQueue::TrackList makeTracks(size_t count, const string& prefix)
+    {
+        PlaybackQueue::TrackList ret;
+        for (size_t i = 0; i < count; i++)
+        {
+            string name = prefix + to_string(i);
+            ret.push_back(make_shared<data::Track>("/music/" + name + ".flac", name, "artist " + name, "album"));
+        }
+        return ret;
+    }
+
+    // count tracks by artists artist 0 .. artist (artists - 1), in turn
+    PlaybackQueue::TrackList makeArtistTracks(size_t count, size_t artists)
+    {
+        PlaybackQueue::TrackList ret;
+        for (size_t i = 0; i < count; i++)
+        {
+            string name = "t" + to_string(i);
+            ret.push_back(make_shared<data::Track>("/music/" + name + ".flac", name, "artist " + to_string(i % artists), "album"));
+        }
+        return ret;
+    }
+}
+
+int main()
+{
+    PlaybackQueue queue;
+    queue.append(makeTracks(10, "a"));
+
+    // moving through the queue does not make the tracks look changed
+    uint64_t version = queue.version();
+    queue.advance();
+    queue.advance(3);
+    queue.back();
+    queue.jump(7);
+    CHECK(queue.version() == version);
+    CHECK(queue.currentIndex() == 7);
+    CHECK(queue.current()->name == "a7");
+
+    queue.append(makeTracks(5, "b"));
+    CHECK(queue.version() != version);
+    CHECK(queue.snapshot().tracks.size() == 15);
+
+    // lists that are far enough behind are dropped as a whole,
+    // the played tracks of the list that is playing stay
+    PlaybackQueue trimmed;
+    for (int list = 0; list < 30; list++)
+    {
+        trimmed.append(makeTracks(100, "l" + to_string(list) + "-"));
+    }
+    trimmed.jump(2950);
+    CHECK(trimmed.current()->name == "l29-50");
+    CHECK(trimmed.size() < 1200);
+    CHECK(trimmed.currentIndex() >= 1000);
+    CHECK(trimmed.size() - trimmed.currentIndex() == 50);
+
+    trimmed.back(1000);
+    CHECK(trimmed.current()->name == "l19-50");
+
+    // one long list, which could be shuffled, is not cut into
+    PlaybackQueue single;
+    single.append(makeTracks(3000, "s"), PlaybackQueue::Order::shuffled);
+    single.advance(2500);
+    CHECK(single.size() == 3000);
+
+    // every position maps to a different one, whatever the size
+    for (size_t size : { 1, 2, 3, 4, 5, 7, 15, 16, 17, 63, 64, 100, 1000, 4097 })
+    {
+        Shuffle shuffle(size, 12345);
+        vector<bool> seen(size);
+        for (size_t i = 0; i < size; i++)
+        {
+            CHECK(shuffle[i] < size && !seen[shuffle[i]]);
+            seen[shuffle[i]] = true;
+        }
+    }
+
+    // another seed, another order
+    Shuffle first(100, 1), second(100, 2);
+    bool differs = false;
+    for (size_t i = 0; i < 100; i++)
+    {
+        differs = differs || first[i] != second[i];
+    }
+    CHECK(differs);
+
+    // an artist does not play twice in a row unless every track
+    // that could have been moved in is by them too
+    PlaybackQueue spread;
+    spread.append(makeArtistTracks(100, 4), PlaybackQueue::Order::shuffledSpreadArtists);
+    set<const data::Track*> played = { spread.current().get() };
+    for (size_t i = 1; i < 100; i++)
+    {
+        const string previous = spread.current()->artistName;
+        spread.advance();
+        played.insert(spread.current().get());
+
+        auto tracks = spread.snapshot().tracks;
+        CHECK(tracks.size() == 100);
+        if (spread.current()->artistName == previous)
+        {
+            for (size_t later = i + 1; later < tracks.size() && later <= i + 64; later++)
+            {
+                CHECK(tracks[later]->artistName == previous);
+            }
+        }
+    }
+    CHECK(played.size() == 100);
+    return 0;
+}
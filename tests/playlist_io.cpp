@@ -0,0 +1,88 @@
+#include "playlist_io.hpp"
+#include "check.hpp"
+
+#include <sstream>
+#include <string>
+
+using namespace std;
+
+using namespace playlistio;
+
+namespace
+{
+    string u32(uint32_t value)
+    {
+        string ret;
+        for (int i = 0; i < 4; i++)
+        {
+            ret += static_cast<char>((value >> (i * 8)) & 0xff);
+        }
+        return ret;
+    }
+
+    ImportResult import(const string& text, PlaylistFormat format, SimplePlaylist& playlist)
+    {
+        istringstream in(text);
+        return importPlaylist(in, format, "/music", playlist);
+    }
+}
+
+int main()
+{
+    data::init();
+    data::addTrack(make_shared<data::Track>("/music/a.flac", "a", "artist", "album"));
+    data::addTrack(make_shared<data::Track>("/music/b c.flac", "b c", "artist", "album"));
+
+    {
+        // byte order mark, a localhost url, an escaped one and a relative path
+        SimplePlaylist playlist("m3u");
+        auto result = import("\xEF\xBB\xBF#EXTM3U\r\nfile://localhost/music/a.flac\nfile:///music/b%20c.flac\na.flac\n",
+                PlaylistFormat::m3u, playlist);
+        CHECK(result.ok);
+        CHECK(result.added == 3);
+        CHECK(result.missing == 0);
+    }
+
+    {
+        SimplePlaylist playlist("remote");
+        auto result = import("file://server/music/a.flac\nhttp://example.com/a.mp3\n", PlaylistFormat::m3u, playlist);
+        CHECK(result.added == 0);
+        CHECK(result.missing == 2);
+    }
+
+    {
+        SimplePlaylist playlist("pls");
+        auto result = import("\xEF\xBB\xBF[playlist]\nFile2=/music/a.flac\nFile1=b c.flac\nNumberOfEntries=2\n",
+                PlaylistFormat::pls, playlist);
+        CHECK(result.added == 2);
+        CHECK(playlist.trackAt(0)->name == "b c");
+    }
+
+    {
+        // the name survives a round trip
+        SimplePlaylist saved("favourites");
+        saved.addTrack(data::findTrack("/music/a.flac"));
+        ostringstream out;
+        CHECK(exportPlaylist(out, PlaylistFormat::binary, saved));
+
+        SimplePlaylist loaded("file name");
+        auto result = import(out.str(), PlaylistFormat::binary, loaded);
+        CHECK(result.ok);
+        CHECK(result.added == 1);
+        CHECK(result.name == "favourites");
+    }
+
+    {
+        // a name length that wraps around when 4 is added to it in 32 bits
+        SimplePlaylist playlist("corrupt");
+        string file = string("PLPL") + u32(1) + u32(0xfffffffe) + u32(1);
+        CHECK(!import(file, PlaylistFormat::binary, playlist).ok);
+
+        file = string("PLPL") + u32(1) + u32(0) + u32(1) + u32(0xffffffff) + "/music/a.flac";
+        CHECK(!import(file, PlaylistFormat::binary, playlist).ok);
+        CHECK(playlist.size() == 0);
+    }
+
+    data::end();
+    return 0;
+}
@@ -0,0 +1,143 @@
+#include "playback_harness.hpp"
+#include "prefetch.hpp"
+#include "media.hpp"
+#include "check.hpp"
+
+#include <atomic>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <iostream>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+using namespace chrono;
+
+namespace
+{
+    atomic<int64_t> firstBufferAt{ 0 };
+
+    int64_t nowNs()
+    {
+        return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    // takes the file out of the page cache, as after a reboot
+    void dropCache(const string& path)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        CHECK(fd >= 0);
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+
+    // how much of the first bytes of the file is in the page cache
+    double resident(const string& path, size_t bytes)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        CHECK(fd >= 0);
+        struct stat info;
+        CHECK(fstat(fd, &info) == 0);
+        size_t length = min<size_t>(info.st_size, bytes);
+        void* mapping = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        CHECK(mapping != MAP_FAILED);
+
+        size_t page = sysconf(_SC_PAGESIZE);
+        vector<unsigned char> pages((length + page - 1) / page);
+        CHECK(mincore(mapping, length, pages.data()) == 0);
+        munmap(mapping, length);
+        return count_if(pages.begin(), pages.end(), [](unsigned char p) { return p & 1; }) / double(pages.size());
+    }
+
+    // time from the play command until the first buffer reaches the sink
+    double startup(const shared_ptr<data::Track>& track)
+    {
+        firstBufferAt = 0;
+        int64_t sentAt = nowNs();
+        playback::sendPlaybackCommand(playback::Command::play({ track }, { playback::PlaybackOption::stopCurrentPlayback }));
+        CHECK(PlaybackHarness::waitFor([] { return firstBufferAt != 0; }, seconds(10)));
+        double ret = (firstBufferAt - sentAt) / 1e6;
+
+        playback::sendPlaybackCommand(playback::CommandType::stopAll);
+        CHECK(PlaybackHarness::waitForState(playback::PlaybackState::stopped, seconds(5)));
+        return ret;
+    }
+
+    double median(vector<double> values)
+    {
+        sort(values.begin(), values.end());
+        return values[values.size() / 2];
+    }
+}
+
+// track startup with the page cache dropped, read cold by the source
+// and after prefetch has read the beginning ahead.
+// the files are written to the working directory, /tmp may not be on a disk
+int main(int argc, char** argv)
+{
+    Gst::init(argc, argv);
+
+    string dir = tempDir(".");
+    CHECK(!dir.empty());
+
+    vector<string> paths;
+    for (int i = 0; i < 5; i++)
+    {
+        paths.push_back(dir + "/" + to_string(i) + ".wav");
+        if (!makeTone(paths.back(), "wavenc", 60, 220 * (i + 1)))
+        {
+            return testSkipped;
+        }
+    }
+
+    dropCache(paths[0]);
+    if (resident(paths[0], prefetch::bytesPerTrack) > 0.5)
+    {
+        cout << "this file system keeps files in memory, nothing to measure" << endl;
+        return testSkipped;
+    }
+
+    PlaybackHarness harness;
+    harness.sinkPad()->add_probe(Gst::PAD_PROBE_TYPE_BUFFER, [](const Glib::RefPtr<Gst::Pad>&, const Gst::PadProbeInfo&)
+    {
+        int64_t none = 0;
+        firstBufferAt.compare_exchange_strong(none, nowNs());
+        return Gst::PAD_PROBE_OK;
+    });
+
+    vector<double> cold, prefetched;
+    for (auto& path : paths)
+    {
+        auto track = make_shared<data::Track>(path, path, "test", "test");
+        dropCache(path);
+        cold.push_back(startup(track));
+    }
+
+    prefetch::start();
+    for (auto& path : paths)
+    {
+        auto track = make_shared<data::Track>(path, path, "test", "test");
+        dropCache(path);
+        prefetch::upcoming({ path });
+        CHECK(PlaybackHarness::waitFor([&] { return resident(path, prefetch::bytesPerTrack) > 0.9; }, seconds(10)));
+        prefetched.push_back(startup(track));
+    }
+    prefetch::end();
+
+    cout << "startup with a dropped cache: " << median(cold) << " ms cold, "
+        << median(prefetched) << " ms prefetched" << endl;
+
+    for (auto& path : paths)
+    {
+        unlink(path.c_str());
+    }
+    rmdir(dir.c_str());
+    return 0;
+}
@@ -0,0 +1,58 @@
+#include "r128.hpp"
+#include "check.hpp"
+
+#include <vector>
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+
+namespace
+{
+    // interleaved stereo, the same sine on both channels
+    vector<float> sine(unsigned rate, double seconds, double frequency, double dbfs)
+    {
+        const double pi = 3.14159265358979323846;
+        double amplitude = pow(10.0, dbfs / 20.0);
+        size_t frames = static_cast<size_t>(rate * seconds);
+        vector<float> ret(frames * 2);
+        for (size_t frame = 0; frame < frames; frame++)
+        {
+            float sample = static_cast<float>(amplitude * sin(2 * pi * frequency * frame / rate));
+            ret[frame * 2] = sample;
+            ret[frame * 2 + 1] = sample;
+        }
+        return ret;
+    }
+
+    R128Meter measure(unsigned rate, const vector<float>& samples)
+    {
+        R128Meter meter(rate, 2);
+        meter.add(samples.data(), samples.size() / 2);
+        return meter;
+    }
+}
+
+// the EBU Tech 3341 reference: a stereo 1 kHz sine at -23 dBFS is -23 LUFS,
+// at every sample rate the filter coefficients are computed for
+int main()
+{
+    for (unsigned rate : { 44100u, 48000u, 96000u })
+    {
+        auto meter = measure(rate, sine(rate, 20, 1000, -23));
+        cout << rate << " Hz: " << meter.integrated() << " LUFS, peak " << meter.peak() << endl;
+        CHECK(fabs(meter.integrated() + 23) < 0.05);
+        CHECK(fabs(meter.peak() - pow(10.0, -23 / 20.0)) < 0.001);
+        CHECK(meter.gatedBlocks() > 0);
+
+        // 10 dB quieter is 10 LU quieter
+        auto quieter = measure(rate, sine(rate, 20, 1000, -33));
+        CHECK(fabs(quieter.integrated() + 33) < 0.05);
+    }
+
+    // silence is gated out completely
+    auto silent = measure(48000, vector<float>(48000 * 2 * 5));
+    CHECK(silent.gatedBlocks() == 0);
+    CHECK(silent.integrated() < -1000);
+    return 0;
+}
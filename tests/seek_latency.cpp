@@ -0,0 +1,116 @@
+#include "playback_harness.hpp"
+#include "media.hpp"
+#include "check.hpp"
+
+#include <atomic>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+using namespace chrono;
+
+namespace
+{
+    // set by the sink pad probes: a flush went through, then the first buffer after it
+    atomic<bool>    flushed{ false };
+    atomic<int64_t> firstBufferAt{ 0 };
+
+    int64_t nowNs()
+    {
+        return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    // time from sending a seek until audio from the new position reaches the sink
+    double seekLatency(gint64 position, bool accurate)
+    {
+        flushed = false;
+        firstBufferAt = 0;
+
+        int64_t sentAt = nowNs();
+        playback::sendPlaybackCommand(playback::Command::seek(position, false, accurate));
+        CHECK(PlaybackHarness::waitFor([] { return firstBufferAt != 0; }, seconds(5)));
+        return (firstBufferAt - sentAt) / 1e6;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Gst::init(argc, argv);
+
+    struct Format
+    {
+        const char* name;
+        const char* encoder;
+    };
+    const Format formats[] =
+    {
+        { "mp3",  "lamemp3enc" },
+        { "flac", "flacenc" },
+        { "ogg",  "vorbisenc ! oggmux" },
+    };
+
+    string dir = tempDir();
+    CHECK(!dir.empty());
+
+    PlaybackHarness harness;
+    auto pad = harness.sinkPad();
+    pad->add_probe(Gst::PAD_PROBE_TYPE_EVENT_FLUSH, [](const Glib::RefPtr<Gst::Pad>&, const Gst::PadProbeInfo& info)
+    {
+        if (info.get_event()->get_event_type() == Gst::EVENT_FLUSH_STOP)
+        {
+            flushed = true;
+        }
+        return Gst::PAD_PROBE_OK;
+    });
+    pad->add_probe(Gst::PAD_PROBE_TYPE_BUFFER, [](const Glib::RefPtr<Gst::Pad>&, const Gst::PadProbeInfo&)
+    {
+        if (flushed && firstBufferAt == 0)
+        {
+            firstBufferAt = nowNs();
+        }
+        return Gst::PAD_PROBE_OK;
+    });
+
+    bool any = false;
+    for (auto& format : formats)
+    {
+        string path = dir + "/tone." + format.name;
+        if (!makeTone(path, format.encoder, 60))
+        {
+            cout << format.name << ": no encoder, skipped" << endl;
+            continue;
+        }
+        any = true;
+
+        auto track = make_shared<data::Track>(path, format.name, "test", "test");
+        playback::sendPlaybackCommand(playback::Command::play({ track },
+                    { playback::PlaybackOption::stopCurrentPlayback }));
+        CHECK(PlaybackHarness::waitFor([&]
+        {
+            auto now = playback::nowPlaying();
+            return now.state == playback::PlaybackState::playing && now.trackId == track->id;
+        }, seconds(5)));
+
+        for (bool accurate : { false, true })
+        {
+            vector<double> latencies;
+            for (int at : { 40, 10, 50, 5, 30, 20 })
+            {
+                latencies.push_back(seekLatency(at * Gst::SECOND, accurate));
+            }
+            sort(latencies.begin(), latencies.end());
+            double median = latencies[latencies.size() / 2];
+            cout << format.name << (accurate ? " accurate" : " key unit") << " seek: median "
+                << median << " ms, max " << latencies.back() << " ms" << endl;
+
+            // the sink buffers a few hundred ms at most, a seek that decodes
+            // from the start of the file would take seconds
+            CHECK(median < 250);
+        }
+    }
+
+    playback::sendPlaybackCommand(playback::CommandType::stopAll);
+    return any ? 0 : testSkipped;
+}
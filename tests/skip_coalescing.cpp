@@ -0,0 +1,84 @@
+#include "playback_harness.hpp"
+#include "media.hpp"
+#include "check.hpp"
+
+#include <vector>
+#include <chrono>
+#include <iostream>
+#include <unistd.h>
+
+using namespace std;
+using namespace chrono;
+
+namespace
+{
+    vector<shared_ptr<data::Track>> tracks;
+
+    // all of them reach the playback thread at once
+    void burst(const vector<playback::CommandType>& types)
+    {
+        for (auto type : types)
+        {
+            playback::Command command(type);
+            CHECK(playback::playbackControl.push(move(command)));
+        }
+        playback::wakePlaybackThread();
+    }
+
+    bool waitForTrack(size_t index)
+    {
+        return PlaybackHarness::waitFor([index]
+        {
+            auto now = playback::nowPlaying();
+            return now.state == playback::PlaybackState::playing && now.trackId == tracks[index]->id;
+        }, seconds(5));
+    }
+
+    void play()
+    {
+        playback::sendPlaybackCommand(playback::Command::play({ tracks.begin(), tracks.end() },
+                    { playback::PlaybackOption::stopCurrentPlayback }));
+        CHECK(waitForTrack(0));
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Gst::init(argc, argv);
+
+    string dir = tempDir();
+    CHECK(!dir.empty());
+    if (!makeTone(dir + "/tone.wav", "wavenc", 30))
+    {
+        return testSkipped;
+    }
+    // tracks are told apart by their path
+    for (int i = 0; i < 20; i++)
+    {
+        string path = dir + "/" + to_string(i) + ".wav";
+        CHECK(symlink((dir + "/tone.wav").c_str(), path.c_str()) == 0);
+        tracks.push_back(make_shared<data::Track>(path, to_string(i), "test", "test"));
+    }
+
+    PlaybackHarness harness;
+
+    // ten nexts build the source of the track that ends up playing and its preroll, nothing in between
+    play();
+    size_t before = output::attachedTotal();
+    burst(vector<playback::CommandType>(10, playback::CommandType::next));
+    CHECK(waitForTrack(10));
+    size_t built = output::attachedTotal() - before;
+    cout << "10 nexts built " << built << " track sources" << endl;
+    CHECK(built <= 2);
+
+    // at the first track previous has nowhere to go, the next after it still counts
+    play();
+    burst({ playback::CommandType::previous, playback::CommandType::next });
+    CHECK(waitForTrack(1));
+
+    play();
+    burst({ playback::CommandType::next, playback::CommandType::next, playback::CommandType::next,
+            playback::CommandType::previous });
+    CHECK(waitForTrack(2));
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include "playlist.hpp"
+#include "workers.hpp"
+#include "check.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include <boost/format.hpp>
+
+using namespace std;
+using namespace chrono;
+
+using boost::format;
+
+// time of one smart playlist evaluation over a large library,
+// from one thread up to one per core
+int main()
+{
+    const size_t trackCount = 200000;
+    const size_t artistCount = 500;
+    const int    rounds = 20;
+
+    data::init();
+
+    // straight into the list, data::addTrack keeps it sorted
+    // one insertion at a time, which takes longer than the benchmark
+    auto& library = data::allArtists->allAlbums->tracks;
+    for (size_t i = 0; i < trackCount; i++)
+    {
+        library.push_back(make_shared<data::Track>(
+                    "/music/" + to_string(i) + ".flac",
+                    "track " + to_string(i),
+                    "artist " + to_string(i % artistCount),
+                    "album " + to_string(i % (artistCount * 10))));
+    }
+
+    SmartPlaylist playlist("benchmark", make_unique<ArtistNameCondition>("artist 7"));
+    const size_t expected = trackCount / artistCount;
+
+    double single = 0;
+    for (size_t threads = 1; threads <= WorkerPool::defaultThreadCount(); threads++)
+    {
+        SmartPlaylist::setThreadCount(threads);
+        // starts the pool
+        CHECK(playlist.getTracks().size() == expected);
+
+        auto start = steady_clock::now();
+        for (int i = 0; i < rounds; i++)
+        {
+            CHECK(playlist.getTracks().size() == expected);
+        }
+        double ms = duration<double, milli>(steady_clock::now() - start).count() / rounds;
+        if (threads == 1)
+        {
+            single = ms;
+        }
+
+        cout << format("%2u threads: %7.2f ms per evaluation, %.2fx") % threads % ms % (single / ms) << endl;
+    }
+
+    data::end();
+    return 0;
+}
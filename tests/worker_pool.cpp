@@ -0,0 +1,40 @@
+#include "workers.hpp"
+#include "check.hpp"
+
+#include <atomic>
+#include <vector>
+
+using namespace std;
+
+int main()
+{
+    WorkerPool pool(4);
+
+    // every index exactly once
+    vector<atomic<int>> seen(10007);
+    pool.parallelFor(seen.size(), 100, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            seen[i]++;
+        }
+    });
+    for (auto& count : seen)
+    {
+        CHECK(count == 1);
+    }
+
+    // every worker calls parallelFor from inside the pool at once,
+    // which used to leave all of them waiting for the jobs behind them
+    atomic<size_t> inner{ 0 };
+    pool.parallelFor(pool.size() * 4, 1, [&](size_t, size_t)
+    {
+        pool.parallelFor(64, 4, [&](size_t begin, size_t end)
+        {
+            inner += end - begin;
+        });
+    });
+    CHECK(inner == pool.size() * 4 * 64);
+
+    return 0;
+}